@@ -0,0 +1,48 @@
+#include "Arduino.h"
+#include "Checkpoint.h"
+
+#if WARM_RESTART_ENABLED
+
+Checkpoint checkpoint __attribute__((section(".noinit")));
+
+// hash of the build time and the checkpoint size (changes with every build of this file)
+static constexpr uint16_t buildHash(const char *s, uint16_t h)
+{
+  return *s ? buildHash(s + 1, (uint16_t)(h * 33 + *s)) : h;
+}
+static constexpr uint16_t BUILD_SIGNATURE = buildHash(__DATE__ " " __TIME__, sizeof(Checkpoint));
+
+static uint16_t checkpointChecksum()
+{
+  const uint8_t *data = (const uint8_t *)&checkpoint;
+  uint8_t sum1 = 0;
+  uint8_t sum2 = 0;
+  for (uint8_t i = 0; i < offsetof(Checkpoint, checksum); i++)
+  {
+    sum1 += data[i];
+    if (sum1 < data[i]) { ++sum1;}   // mod 255 (end-around carry)
+    sum2 += sum1;
+    if (sum2 < sum1) { ++sum2;}
+  }
+  return ((uint16_t)sum2 << 8) | sum1;
+}
+
+void checkpointSeal()
+{
+  checkpoint.magic = CHECKPOINT_MAGIC;
+  checkpoint.build = BUILD_SIGNATURE;
+  checkpoint.checksum = checkpointChecksum();
+}
+
+bool checkpointValid()
+{
+  return checkpoint.magic == CHECKPOINT_MAGIC && checkpoint.build == BUILD_SIGNATURE &&
+         checkpoint.checksum == checkpointChecksum();
+}
+
+void checkpointClear()
+{
+  checkpoint.magic = 0;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef Checkpoint_h
+#define Checkpoint_h
+
+// Warm restart: the gate state is checkpointed to a .noinit RAM section
+// (not cleared by the C runtime), protected by a magic number and a checksum.
+// After a watchdog, brown-out or external reset the checkpoint survives,
+// setup() resumes the interrupted gate within milliseconds (no display
+// and startup delays first) with its counts, live time and settings.
+//
+// Counts and live time are both taken at the last checkpoint, so the rate
+// stays consistent: pulses and time after it are lost together. The lost
+// time (since the checkpoint plus the restart) is accumulated per gate,
+// the checkpoint part is its upper bound CHECKPOINT_TICKS Timer0 periods.
+// After a power-on the RAM content fails the checksum (cold start), a checkpoint
+// of another firmware build fails the build signature (layout and settings may differ).
+
+// SETUP
+#define WARM_RESTART_ENABLED 0  // [0 or 1] RAM: 55 bytes
+#define CHECKPOINT_TICKS 8      // checkpoint period [Timer0 periods] 8 * 1024 mks (about 40 mks in the tick ISR)
+
+#include "Arduino.h"
+#include <stddef.h>
+
+#define CHECKPOINT_MAGIC 0x4E43   // "NC"
+#define CHECKPOINT_CHANNELS 2
+
+struct Checkpoint
+{
+  uint16_t magic;
+  uint16_t build;             // firmware build signature
+  uint16_t gate;              // gate number
+  char source;
+  uint8_t active;             // 1 == the gate was counting
+  uint8_t interruptions;      // resets during the gate
+  uint32_t lengthMks;         // settings
+  uint32_t targetCounts;
+  uint32_t widthMin[CHECKPOINT_CHANNELS];
+  uint32_t widthMax[CHECKPOINT_CHANNELS];
+  uint32_t liveMks;           // gate state
+  uint32_t lostMks;
+  uint16_t counts[CHECKPOINT_CHANNELS];
+  uint16_t rejectedShort[CHECKPOINT_CHANNELS];
+  uint16_t rejectedLong[CHECKPOINT_CHANNELS];
+  uint16_t checksum;          // Fletcher-16 of all fields above
+};
+
+extern Checkpoint checkpoint;
+
+void checkpointSeal();        // set magic, build signature and checksum (interrupts disabled)
+bool checkpointValid();       // checkpoint survived the reset and was written by this build
+void checkpointClear();       // invalidate
+
+#endif
@@ -0,0 +1,121 @@
+#include "Arduino.h"
+#include "NeutronCounter.h"
+#include "FixedPoint.h"
+#include "FeynmanY.h"
+
+#if FEYNMAN_ENABLED
+
+FeynmanY::FeynmanY(NeutronCounter *counters, uint8_t countersNumber, const uint16_t *widths_ticks, uint8_t widthsNumber)
+{
+  counter = counters;
+  counterNum = countersNumber;
+  widths = widths_ticks;
+  widthNum = (widthsNumber > FY_MAX_WIDTHS) ? FY_MAX_WIDTHS : widthsNumber;
+  running = false;
+  aligned = false;
+  for (uint8_t w = 0; w < FY_MAX_WIDTHS; w++)
+  {
+    n[w] = 0;
+    s1[w] = 0;
+    s2[w] = 0;
+  }
+}
+
+void FeynmanY::start()
+{
+  uint8_t oldSREG = SREG;   // called from the gate (may be in ISR)
+  cli();
+  for (uint8_t w = 0; w < widthNum; w++)
+  {
+    tickCount[w] = 0;
+    n[w] = 0;
+    s1[w] = 0;
+    s2[w] = 0;
+  }
+  aligned = false;
+  running = true;
+  SREG = oldSREG;
+}
+
+void FeynmanY::stop()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  running = false;
+  SREG = oldSREG;
+}
+
+// Timer0 Compare B tick from the gate (interrupts are disabled)
+// The total count is read once, every width only compares its tick counter,
+// so the cost is a few additions per width and one multiply per closed sub-gate.
+void FeynmanY::tick()
+{
+  if (!running) { return;}
+  uint16_t total = 0;
+  for (uint8_t i = 0; i < counterNum; i++) { total += counter[i].GetPulseNumber();}
+  if (!aligned)
+  {
+    for (uint8_t w = 0; w < widthNum; w++) { lastTotal[w] = total;}
+    aligned = true;
+    return;
+  }
+  for (uint8_t w = 0; w < widthNum; w++)
+  {
+    if (++tickCount[w] < widths[w]) { continue;}
+    uint16_t c = total - lastTotal[w];
+    lastTotal[w] = total;
+    tickCount[w] = 0;
+    ++n[w];
+    s1[w] += c;
+    s2[w] += (uint32_t)c * c;
+  }
+}
+
+// Y [ppm] of width w, see feynmanYPpm()
+int32_t FeynmanY::yPpm(uint8_t w)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  uint32_t subGates = n[w];
+  uint32_t sum = s1[w];
+  uint64_t sumSq = s2[w];
+  SREG = oldSREG;
+  return feynmanYPpm(subGates, sum, sumSq);
+}
+
+// F,<gate>,<width [mks]>,<sub-gates>,<counts>,<Y [ppm]>
+void FeynmanY::printResults(uint16_t gateNumber)
+{
+  for (uint8_t w = 0; w < widthNum; w++)
+  {
+    uint32_t widthMks = (uint32_t)widths[w] * T0_MKS_PER_PERIOD;
+    int32_t y = yPpm(w);
+    cli();
+    uint32_t subGates = n[w];
+    uint32_t sum = s1[w];
+    sei();
+
+    Serial.print(F("Feynman-Y T = "));
+    Serial.print(widthMks);
+    Serial.print(F(" mks  n = "));
+    Serial.print(subGates);
+    Serial.print(F("  mean = "));
+    printFixed(Serial, subGates ? (uint32_t)(((uint64_t)sum * 1000 + subGates / 2) / subGates) : 0, 3);
+    Serial.print(F("  Y = "));
+    printFixedSigned(Serial, y, 6);
+    Serial.println();
+
+    Serial.print(F("F,"));
+    Serial.print(gateNumber);
+    Serial.print(',');
+    Serial.print(widthMks);
+    Serial.print(',');
+    Serial.print(subGates);
+    Serial.print(',');
+    Serial.print(sum);
+    Serial.print(',');
+    Serial.println(y);
+  }
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef FeynmanY_h
+#define FeynmanY_h
+
+// Feynman-Y (variance-to-mean) neutron noise analysis.
+// The gate is split into consecutive sub-gates of several widths at the same time
+// (every width is a number of Timer0 periods, 1024 mks). For each width the number
+// of sub-gates n and the moments S1 = sum(c), S2 = sum(c^2) of the total count c per
+// sub-gate are accumulated in integers by the gate's Timer0 Compare B tick:
+//
+//   Y(T) = (n * S2 - S1^2) / (n * S1) - 1
+//
+// Y > 0 is the correlated (fission chain) excess over a Poisson source.
+//
+// A pulse adds all its counts (width / count period) at the falling front, so one
+// long pulse lands in a single sub-gate. Sub-gates shorter than one count period
+// (101 * 64 mks = 6.46 ms, 7 Timer0 periods) see this clustering instead of the
+// neutron correlations: use widths of 7 periods and more.
+
+// SETUP
+#define FEYNMAN_ENABLED 0       // [0 or 1]
+#define FY_MAX_WIDTHS 8         // RAM: 20 bytes per FY_MAX_WIDTHS (not per used width)
+
+#include <stdint.h>
+
+class NeutronCounter;
+
+// Plain C++ (no Arduino core) up to the class: the host tools (tools/nc_analyze)
+// rebuild the sub-gates from list mode records and compare with the F records.
+
+// sub-gate of an event counted in Timer0 period p >= 1 (E record count period):
+// sub-gates start at the first tick after start(), sub-gate k holds the periods k * width + 1 .. (k + 1) * width
+inline uint32_t feynmanSubGate(uint32_t period, uint16_t width)
+{
+  return (period - 1) / width;
+}
+
+// Y = (n * S2 - S1^2) / (n * S1) - 1 [ppm], n * S2 >= S1^2 always
+inline int32_t feynmanYPpm(uint32_t subGates, uint32_t sum, uint64_t sumSq)
+{
+  if (subGates == 0 || sum == 0) { return 0;}
+  uint64_t num = (uint64_t)subGates * sumSq - (uint64_t)sum * sum;
+  uint64_t den = (uint64_t)subGates * sum;
+  uint64_t ratio = (num / den) * 1000000ULL + ((num % den) * 1000000ULL) / den;  // (Y + 1) [ppm]
+  if (ratio > 0x7FFFFFFFULL) { ratio = 0x7FFFFFFFULL;}
+  return (int32_t)ratio - 1000000L;
+}
+
+class FeynmanY
+{
+  public:
+    // Constructor, widths [Timer0 periods] must stay valid (const global)
+    FeynmanY(NeutronCounter *counters, uint8_t countersNumber, const uint16_t *widths_ticks, uint8_t widthsNumber);
+
+    void start();         // clear moments (call after NeutronCounter::startCounting)
+    void stop();          // stop, incomplete sub-gates are dropped
+    void tick();          // Timer0 Compare B tick (called by the gate)
+    void printResults(uint16_t gateNumber);  // Y(T) for every width
+
+    int32_t yPpm(uint8_t w);  // Y [ppm] of width w
+
+  private:
+    NeutronCounter *counter;
+    uint8_t counterNum;
+    const uint16_t *widths;
+    uint8_t widthNum;
+
+    volatile bool running;
+    volatile bool aligned;          // sub-gates start at the first Compare B after start()
+    uint16_t tickCount[FY_MAX_WIDTHS];
+    uint16_t lastTotal[FY_MAX_WIDTHS];   // total count at the sub-gate start (mod 2^16)
+    volatile uint32_t n[FY_MAX_WIDTHS];  // sub-gates
+    volatile uint32_t s1[FY_MAX_WIDTHS]; // sum of counts
+    volatile uint64_t s2[FY_MAX_WIDTHS]; // sum of squared counts
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef FixedPoint_h
+#define FixedPoint_h
+
+// Fixed point units for timer ticks, microseconds and count rates.
+// AVR has no FPU: everything is integer, floating point is never needed
+// (printFixed() formats the results).
+//
+// mks_q8_t  - time in 1/256 mks (Q24.8), exact for any prescaler at 8 or 16 MHz
+// mcps      - count rate in 1/1000 counts per second
+
+#include "Arduino.h"
+
+typedef uint32_t mks_q8_t;
+#define MKS_Q8_SHIFT 8
+
+// Atmega328 Timer1 (and Timer0) clock divider for the CSn2:0 prescaler bits
+constexpr uint16_t t1PrescalerDivider(uint8_t cs)
+{
+  return (cs == 1) ? 1 : (cs == 2) ? 8 : (cs == 3) ? 64 : (cs == 4) ? 256 : (cs == 5) ? 1024 : 0;
+}
+
+// Atmega328 Timer2 clock divider for the CS22:0 prescaler bits
+constexpr uint16_t t2PrescalerDivider(uint8_t cs)
+{
+  return (cs == 1) ? 1 : (cs == 2) ? 8 : (cs == 3) ? 32 : (cs == 4) ? 64 :
+         (cs == 5) ? 128 : (cs == 6) ? 256 : (cs == 7) ? 1024 : 0;
+}
+
+// timer tick length [1/256 mks] for the clock divider
+constexpr mks_q8_t mksQ8PerTick(uint16_t divider)
+{
+  return ((mks_q8_t)divider << MKS_Q8_SHIFT) / (F_CPU / 1000000UL);
+}
+
+// ticks -> mks (integer part), no overflow while the result fits 32 bits
+constexpr uint32_t ticksToMks(uint32_t ticks, mks_q8_t q8PerTick)
+{
+  return ticks * (q8PerTick >> MKS_Q8_SHIFT) + ((ticks * (q8PerTick & 0xFF)) >> MKS_Q8_SHIFT);
+}
+
+// Timer0 (Arduino millis() timer: prescaler 64, 256 ticks per period)
+constexpr mks_q8_t T0_MKS_Q8_PER_TICK = mksQ8PerTick(64);
+constexpr uint32_t T0_MKS_PER_TICK = ticksToMks(1, T0_MKS_Q8_PER_TICK);      // 4 mks at 16 MHz
+constexpr uint32_t T0_MKS_PER_PERIOD = ticksToMks(256, T0_MKS_Q8_PER_TICK);  // 1024 mks at 16 MHz
+
+// 32 bit arithmetic only: AVR has no divide instruction, the libgcc 64 bit division
+// is larger and slower than two or three 32 bit ones.
+
+// n * 1000^steps / d with its remainder: long division in 10^3 digits,
+// d < 2^22 (the remainder times 1000 fits 32 bits), the quotient must fit 32 bits
+inline uint32_t mulPow1000Div(uint32_t n, uint8_t steps, uint32_t d, uint32_t &rem)
+{
+  uint32_t q = n / d;
+  uint32_t r = n % d;
+  while (steps--)
+  {
+    r *= 1000;
+    q = q * 1000 + r / d;
+    r %= d;
+  }
+  rem = r;
+  return q;
+}
+
+// count rate [1/1000 counts per second], live time above 2^22 mks (4.2 s) is
+// scaled to 22 bits (relative error < 0.5 ppm)
+inline uint32_t rateMilliCps(uint32_t counts, uint32_t liveMks)
+{
+  if (liveMks == 0) { return 0;}
+  uint8_t shift = 0;
+  while (liveMks >= (1UL << 22)) { liveMks >>= 1; ++shift;}
+  uint32_t rem;
+  uint32_t rate = mulPow1000Div(counts, 3, liveMks, rem);
+  if (shift == 0) { return rate + ((rem << 1) >= liveMks);}   // rounded
+  return (rate + (1UL << (shift - 1))) >> shift;
+}
+
+// integer square root (floor)
+inline uint32_t isqrt(uint32_t value)
+{
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+  while (bit > value) { bit >>= 2;}
+  while (bit != 0)
+  {
+    if (value >= root + bit)
+    {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else { root >>= 1;}
+    bit >>= 2;
+  }
+  return root;
+}
+
+// value / sqrt(counts) rounded, counts > 0: counts is scaled by 4^m to 31..32 bits,
+// so its root has 16 bits (relative error < 2^-16)
+inline uint32_t divBySqrt(uint32_t value, uint32_t counts)
+{
+  uint8_t m = 0;
+  while (counts < (1UL << 30)) { counts <<= 2; ++m;}
+  uint32_t root = isqrt(counts);
+  if (counts - root * root > root) { ++root;}   // rounded (root < 2^16)
+  // value * 2^m / root, the remainder times 2^m fits 31 bits
+  uint32_t q = value / root;
+  uint32_t r = value % root;
+  return (q << m) + (((r << m) + (root >> 1)) / root);
+}
+
+// Poisson standard deviation of the count rate sqrt(counts) / live time [1/1000 counts per second]
+inline uint32_t rateSigmaMilliCps(uint32_t counts, uint32_t liveMks)
+{
+  if (counts == 0) { return 0;}
+  return divBySqrt(rateMilliCps(counts, liveMks), counts);   // rate / sqrt(counts)
+}
+
+// Poisson relative uncertainty 1 / sqrt(counts) [ppm]
+inline uint32_t relUncertaintyPpm(uint32_t counts)
+{
+  if (counts == 0) { return 1000000;}
+  return divBySqrt(1000000, counts);
+}
+
+// counts needed for the relative uncertainty [ppm]: 10^12 / ppm^2 rounded up,
+// 0xFFFFFFFF below 16 ppm (out of 32 bits)
+inline uint32_t countsForUncertainty(uint32_t ppm)
+{
+  if (ppm == 0) { return 0;}
+  if (ppm < 16) { return 0xFFFFFFFFUL;}
+  if (ppm >= 1000000) { return 1;}
+  uint32_t rem;
+  uint32_t counts;
+  if (ppm < 2048)
+  {
+    counts = mulPow1000Div(1, 4, ppm * ppm, rem);   // ppm^2 < 2^22
+  }
+  else
+  {
+    counts = mulPow1000Div(1, 4, ppm, rem);   // ceil(ceil(10^12 / ppm) / ppm)
+    counts += (rem > 0);
+    rem = counts % ppm;
+    counts /= ppm;
+  }
+  return counts + (rem > 0);
+}
+
+// sqrt(a^2 + b^2), the uncertainty of a sum or difference (a and b are scaled to 15 bits)
+inline uint32_t quadratureSum(uint32_t a, uint32_t b)
+{
+  uint8_t shift = 0;
+  while ((a | b) >= (1UL << 15)) { a >>= 1; b >>= 1; ++shift;}
+  return isqrt(a * a + b * b) << shift;
+}
+
+// print unsigned fixed point number: value / 10^decimals
+inline void printFixed(Print &out, uint32_t value, uint8_t decimals)
+{
+  uint32_t divider = 1;
+  for (uint8_t i = 0; i < decimals; i++) { divider *= 10;}
+  out.print(value / divider);
+  if (decimals == 0) { return;}
+  out.print('.');
+  uint32_t frac = value % divider;
+  for (divider /= 10; divider > 1 && frac < divider; divider /= 10) { out.print('0');}
+  out.print(frac);
+}
+
+// print signed fixed point number: value / 10^decimals
+inline void printFixedSigned(Print &out, int32_t value, uint8_t decimals)
+{
+  if (value < 0)
+  {
+    out.print('-');
+    printFixed(out, 0UL - (uint32_t)value, decimals);
+  }
+  else { printFixed(out, (uint32_t)value, decimals);}
+}
+
+#endif
@@ -0,0 +1,349 @@
+#include "Arduino.h"
+#include "Gate.h"
+#include "FixedPoint.h"
+#include "ListMode.h"
+#include "Multiscaler.h"
+#include "FeynmanY.h"
+#include "RossiAlpha.h"
+
+extern CountingGate gate;
+#if MULTISCALER_ENABLED
+extern Multiscaler mcs;
+#endif
+#if FEYNMAN_ENABLED
+extern FeynmanY fy;
+#endif
+
+CountingGate::CountingGate(NeutronCounter *counters, uint8_t countersNumber, uint8_t compareUnit, bool primaryGate)
+{
+  counter = counters;
+  counterNum = countersNumber;
+  intMask = 0;
+  compareBit = (compareUnit == GATE_COMPARE_A) ? (1 << OCIE0A) : (1 << OCIE0B);   // OCF0x bits are the same
+  primary = primaryGate;
+  armed = false;
+  active = false;
+  started = false;
+  finished = false;
+  startMks = 0;
+  stopMks = 0;
+  startLatency = 0;
+  source = GATE_SRC_BUTTON;
+  number = 0;
+  lengthMks = 0;
+  endMks = 0;
+  timed = false;
+  finalPeriod = false;
+  targetCounts = 0;
+  endReason = GATE_END_EXTERNAL;
+  interruptions = 0;
+  lostMks = 0;
+  checkpointTicks = 0;
+}
+
+void CountingGate::init()
+{
+  for (uint8_t i = 0; i < counterNum; i++) { intMask |= (1 << counter[i].intNum);}
+  if (!primary) { return;}
+  pinMode(TRIG_OUT_PIN, OUTPUT);
+  digitalWrite(TRIG_OUT_PIN, LOW);
+#if (TRIGGER_INPUT_MODE != TRIG_NONE)
+  pinMode(TRIG_IN_PIN, INPUT);
+  PCMSK0 |= (1 << TRIG_IN_BIT);   // pin change interrupt for the trigger pin only
+  PCIFR |= (1 << PCIF0);          // clear pin change flag
+  PCICR |= (1 << PCIE0);          // turn on PCINT[7:0] interrupt
+#endif
+}
+
+// Timer0 Compare B interrupt handler (every 1024 mks, the millis() timer is not changed)
+ISR(TIMER0_COMPB_vect)
+{
+  gate.tick();
+}
+
+#if INDEPENDENT_GATES
+extern CountingGate gate1;
+
+// Timer0 Compare A interrupt handler (channel 1 gate)
+ISR(TIMER0_COMPA_vect)
+{
+  gate1.tick();
+}
+#endif
+
+#if (TRIGGER_INPUT_MODE != TRIG_NONE)
+// External trigger input (pin change) interrupt handler
+ISR(PCINT0_vect)
+{
+  uint8_t entryTicks = TCNT0;
+  if (PINB & (1 << TRIG_IN_BIT))
+  {
+    if (gate.armed) { gate.fire(GATE_SRC_TRIGGER, entryTicks);}
+  }
+#if (TRIGGER_INPUT_MODE == TRIG_LEVEL)
+  else if (gate.source == GATE_SRC_TRIGGER)
+  {
+    gate.stop();
+  }
+#endif
+}
+#endif
+
+// prepare counters: handlers are attached and timers started,
+// but external interrupts stay masked until fire()
+// (not before the results of the last gate are taken by takeFinished())
+void CountingGate::arm()
+{
+  if (active || armed || finished) { return;}
+  uint8_t oldSREG = SREG;
+  cli();
+  for (uint8_t i = 0; i < counterNum; i++)
+  {
+    counter[i].flush();
+    counter[i].startCounting();
+  }
+  EIMSK &= ~intMask;
+  armed = true;
+  SREG = oldSREG;
+}
+
+// start counting, entryTicks == TCNT0 at the moment of the start request
+// (the start latency does not include the time from the trigger edge to the ISR entry)
+void CountingGate::fire(char src, uint8_t entryTicks)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  if (!armed) { SREG = oldSREG; return;}
+  if (primary) { PORTB |= (1 << TRIG_OUT_BIT);}   // trigger the next board first
+  EIFR = intMask;                 // clear INTx flags latched while armed
+  EIMSK |= intMask;               // counting starts here
+  uint8_t armedTicks = TCNT0;
+  startMks = micros();
+  startLatency = ticksToMks((uint8_t)(armedTicks - entryTicks), T0_MKS_Q8_PER_TICK);
+  endMks = startMks + lengthMks;
+  timed = (lengthMks > 0) && !(TRIGGER_INPUT_MODE == TRIG_LEVEL && src == GATE_SRC_TRIGGER);
+  finalPeriod = false;
+  TIFR0 |= compareBit;            // clear Timer0 Compare flag
+  TIMSK0 |= compareBit;           // turn on Timer0 Compare Match Interrupt (gate tick)
+  source = src;
+  armed = false;
+  active = true;
+  started = true;
+  ++number;
+  interruptions = 0;
+  lostMks = 0;
+  checkpointTicks = 0;
+  if (!primary) { SREG = oldSREG; return;}
+#if WARM_RESTART_ENABLED
+  saveCheckpoint();
+#endif
+#if LIST_MODE_ENABLED
+  listModeStart(startMks);
+#endif
+#if ROSSI_ENABLED
+  rossiStart();
+#endif
+#if MULTISCALER_ENABLED
+  mcs.start();
+#endif
+#if FEYNMAN_ENABLED
+  fy.start();
+#endif
+  SREG = oldSREG;
+}
+
+void CountingGate::stop(char reason)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  if (!active) { SREG = oldSREG; return;}
+  EIMSK &= ~intMask;              // counting stops here
+  stopMks = micros();
+  TIMSK0 &= ~compareBit;          // turn off Timer0 Compare Match Interrupt
+  for (uint8_t i = 0; i < counterNum; i++) { counter[i].stopCounting();}
+  endReason = reason;
+  active = false;
+  finished = true;
+  if (!primary) { SREG = oldSREG; return;}
+  PORTB &= ~(1 << TRIG_OUT_BIT);
+#if MULTISCALER_ENABLED
+  mcs.stop();
+#endif
+#if FEYNMAN_ENABLED
+  fy.stop();
+#endif
+#if WARM_RESTART_ENABLED
+  saveCheckpoint();   // final counts, nothing to resume
+#endif
+  SREG = oldSREG;
+}
+
+// gate length [mks] for the following gates, 0 == until stop() (rounded to Timer0 ticks)
+void CountingGate::setLength(uint32_t mks)
+{
+  lengthMks = mks - mks % T0_MKS_PER_TICK;
+}
+
+// the gate ends when the total count reaches (10^6 / ppm)^2, the gate length is the time limit
+void CountingGate::setTargetUncertainty(uint32_t ppm)
+{
+  targetCounts = countsForUncertainty(ppm);
+  // pulse counters are 16 bit: the target must be reached before any single one wraps,
+  // the total of several channels is not enough (one channel may count alone)
+  if (targetCounts > 0xFFFF) { targetCounts = 0xFFFF;}
+}
+
+// Timer0 Compare B (or A) tick (interrupts are disabled)
+// Timer0 compare happens once per period at TCNT0 == OCR0x. OCR0x is double buffered
+// in fast PWM mode (updated at BOTTOM), so one period before the end the compare is
+// moved to the end tick: the gate is stopped exactly at the end tick, not at the next tick.
+void CountingGate::tick()
+{
+  if (!active) { return;}
+  if (primary)
+  {
+#if WARM_RESTART_ENABLED
+    if (++checkpointTicks >= CHECKPOINT_TICKS)
+    {
+      saveCheckpoint();
+      checkpointTicks = 0;
+    }
+#endif
+#if MULTISCALER_ENABLED
+    mcs.tick();
+#endif
+#if LIST_MODE_ENABLED
+    listModeTick();
+#endif
+#if FEYNMAN_ENABLED
+    if (!finalPeriod) { fy.tick();}   // the last period is shortened to the end tick
+#endif
+  }
+  if (targetCounts > 0 && totalCounts() >= targetCounts)
+  {
+    stop(GATE_END_PRECISION);
+    return;
+  }
+  if (!timed) { return;}
+
+  uint32_t now = micros();
+  int32_t left = (int32_t)(endMks - now);   // [mks]
+  if (left < (int32_t)T0_MKS_PER_TICK)
+  {
+    stop(GATE_END_TIME);
+    return;
+  }
+  // [mks] to the next Timer0 BOTTOM, (micros() / tick) mod 256 == TCNT0
+  int32_t toBottom = (256 - (now / T0_MKS_PER_TICK) % 256) * T0_MKS_PER_TICK;
+  if (!finalPeriod && left >= toBottom && left < toBottom + (int32_t)T0_MKS_PER_PERIOD)
+  {
+    // end tick phase, active from the next period
+    if (compareBit == (1 << OCIE0A)) { OCR0A = (uint8_t)(endMks / T0_MKS_PER_TICK);}
+    else { OCR0B = (uint8_t)(endMks / T0_MKS_PER_TICK);}
+    finalPeriod = true;
+  }
+}
+
+#if WARM_RESTART_ENABLED
+void CountingGate::saveCheckpoint()
+{
+  checkpoint.gate = number;
+  checkpoint.source = source;
+  checkpoint.active = active;
+  checkpoint.interruptions = interruptions;
+  checkpoint.lengthMks = lengthMks;
+  checkpoint.targetCounts = targetCounts;
+  checkpoint.liveMks = (active ? micros() : stopMks) - startMks;
+  checkpoint.lostMks = lostMks;
+  for (uint8_t i = 0; i < counterNum && i < CHECKPOINT_CHANNELS; i++)
+  {
+    checkpoint.widthMin[i] = counter[i].widthMin;
+    checkpoint.widthMax[i] = counter[i].widthMax;
+    checkpoint.counts[i] = counter[i].GetPulseNumber();
+    checkpoint.rejectedShort[i] = counter[i].rejectedShort;
+    checkpoint.rejectedLong[i] = counter[i].rejectedLong;
+  }
+  checkpointSeal();
+}
+
+// Warm restart (call instead of arm() in setup, counters and gate are initialised):
+// a counting gate continues with the checkpointed settings, counts and live time,
+// after a finished gate the settings of this firmware stay. Pulses and time after
+// the checkpoint are lost: the time since the checkpoint (at most CHECKPOINT_TICKS
+// periods) and the restart (micros() now) is added to lostMks. The bootloader time before setup() is not measured.
+// cp is taken by value: the checkpoint itself is rewritten by fire().
+void CountingGate::resume(Checkpoint cp)
+{
+  if (!cp.active) { return;}
+
+  uint8_t oldSREG = SREG;
+  cli();
+  lengthMks = cp.lengthMks;
+  targetCounts = cp.targetCounts;
+  number = cp.gate;
+  for (uint8_t i = 0; i < counterNum && i < CHECKPOINT_CHANNELS; i++)
+  {
+    counter[i].setWidthWindow(cp.widthMin[i], cp.widthMax[i]);
+  }
+  --number;   // fire() takes the next number
+  arm();
+  fire(cp.source, TCNT0);
+  for (uint8_t i = 0; i < counterNum && i < CHECKPOINT_CHANNELS; i++)
+  {
+    counter[i].setPulseNumber(cp.counts[i]);
+    counter[i].rejectedShort = cp.rejectedShort[i];
+    counter[i].rejectedLong = cp.rejectedLong[i];
+  }
+  startMks -= cp.liveMks;   // live time continues from the checkpoint
+  endMks = startMks + lengthMks;
+#if LIST_MODE_ENABLED
+  listModeStart(startMks);  // event times from the shifted start, as the S record
+#endif
+  startLatency = 0;
+  interruptions = (cp.interruptions < 0xFF) ? cp.interruptions + 1 : 0xFF;
+  lostMks = cp.lostMks + (uint32_t)CHECKPOINT_TICKS * T0_MKS_PER_PERIOD + micros();
+  saveCheckpoint();
+  SREG = oldSREG;
+}
+#endif
+
+uint32_t CountingGate::totalCounts()
+{
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < counterNum; i++) { total += counter[i].GetPulseNumber();}
+  return total;
+}
+
+uint32_t CountingGate::uncertaintyPpm()
+{
+  return relUncertaintyPpm(totalCounts());
+}
+
+uint32_t CountingGate::liveMks()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  uint32_t live = (active ? micros() : stopMks) - startMks;
+  SREG = oldSREG;
+  return live;
+}
+
+bool CountingGate::takeStarted()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  bool result = started;
+  started = false;
+  SREG = oldSREG;
+  return result;
+}
+
+bool CountingGate::takeFinished()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  bool result = finished;
+  finished = false;
+  SREG = oldSREG;
+  return result;
+}
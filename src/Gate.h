@@ -0,0 +1,100 @@
+#ifndef Gate_h
+#define Gate_h
+
+// Counting gate: starts and stops all counters at once.
+// The slow part (flush, attaching interrupts) is done in advance by arm(),
+// fire() only unmasks the external interrupts, so a gate can be started from
+// the external trigger interrupt in a few cycles. The counts of the last gate
+// stay readable until the next arm().
+// Gate end is timed by Timer0 Compare B (4 mks resolution), live time is measured
+// from the counting start to the counting stop.
+// With a precision target the gate ends earlier, as soon as the Poisson uncertainty
+// of the summed counts reaches the target (checked every Timer0 period).
+// A gate owns its counters only: with INDEPENDENT_GATES channel 1 has its own gate
+// (Timer0 Compare A) with its own length and settings, the primary gate (Compare B)
+// keeps the trigger pins and the analysis modes (list mode, multiscaler, Feynman-Y,
+// Rossi-alpha, warm restart).
+
+// SETUP
+#define TRIG_NONE 0     // external trigger input is not used (button only)
+#define TRIG_EDGE 1     // rising front of the input starts a gate of COUNTING_TIME
+#define TRIG_LEVEL 2    // counting while the input is high (external gate)
+#define TRIGGER_INPUT_MODE TRIG_NONE
+#define INDEPENDENT_GATES 0   // [0 or 1] 0 == one gate for all channels, 1 == channel 0 and channel 1 gated separately
+
+// for Atmega328
+#define TRIG_IN_PIN 8       // D8 == PB0 == PCINT0, external trigger/gate input (pull it down)
+#define TRIG_IN_BIT PB0
+#define TRIG_OUT_PIN 9      // D9 == PB1, high while counting (trigger/gate for the next board)
+#define TRIG_OUT_BIT PB1
+
+#include "Arduino.h"
+#include "NeutronCounter.h"
+#include "Checkpoint.h"
+
+#define GATE_SRC_BUTTON 'B'
+#define GATE_SRC_TRIGGER 'T'
+#define GATE_SRC_REPEAT 'R'     // channel gate restarted while the primary gate counts
+
+#define GATE_COMPARE_B 0        // gate timed by Timer0 Compare B (OCR0B)
+#define GATE_COMPARE_A 1        // gate timed by Timer0 Compare A (OCR0A, PWM on D6 is not used)
+
+#define GATE_END_TIME 'T'       // gate length elapsed
+#define GATE_END_PRECISION 'P'  // precision target reached
+#define GATE_END_EXTERNAL 'X'   // stopped by the trigger input or by the program
+
+class CountingGate
+{
+  public:
+    // Constructor
+    CountingGate(NeutronCounter *counters, uint8_t countersNumber,
+                 uint8_t compareUnit = GATE_COMPARE_B, bool primaryGate = true);
+
+    void init();        // trigger input and output pins
+    void arm();         // prepare counters, the gate can be fired after that
+    void fire(char src, uint8_t entryTicks);  // start counting (ISR safe), entryTicks == TCNT0 at the request
+    void stop(char reason = GATE_END_EXTERNAL);  // stop counting (ISR safe)
+    void setLength(uint32_t mks);   // gate length for the next gates [mks], 0 == until stop()
+    void setTargetUncertainty(uint32_t ppm);  // early stop at this relative uncertainty [ppm] (>= 3907, 16 bit counters), 0 == off
+    void tick();        // Timer0 Compare B (A) handler
+    void resume(Checkpoint cp); // continue the gate interrupted by a reset (warm restart), cp is a copy
+
+    uint32_t liveMks();       // [mks] gate length (so far)
+    uint32_t totalCounts();   // sum of all counters
+    uint32_t uncertaintyPpm();  // Poisson relative uncertainty of totalCounts() [ppm]
+    bool takeStarted();       // true once after the gate start
+    bool takeFinished();      // true once after the gate end
+    NeutronCounter *channels() { return counter;}         // counters of the gate
+    uint8_t channelsNumber() { return counterNum;}
+
+    volatile bool armed;
+    volatile bool active;
+    volatile uint32_t startMks;     // micros() at gate start
+    volatile uint32_t stopMks;      // micros() at gate end
+    volatile uint16_t startLatency; // [mks] from the start request (trigger interrupt entry) to counting enabled,
+                                    // the time from the trigger edge to the interrupt entry is not included
+    volatile char source;           // GATE_SRC_BUTTON, GATE_SRC_TRIGGER, GATE_SRC_SCHEDULER or GATE_SRC_REPEAT
+    uint16_t number;                // gate number since power on
+    uint32_t lengthMks;             // [mks] requested gate length, 0 == until stop()
+    uint32_t targetCounts;          // early stop at this total count, 0 == off
+    volatile char endReason;        // GATE_END_TIME, GATE_END_PRECISION or GATE_END_EXTERNAL
+    uint8_t interruptions;          // resets during the gate (warm restart)
+    uint32_t lostMks;               // [mks] not counted because of the resets (upper bound)
+
+  private:
+    NeutronCounter *counter;
+    uint8_t counterNum;
+    uint8_t intMask;                // EIMSK bits of the counters
+    uint8_t compareBit;             // OCIE0x / OCF0x bit of the gate's Timer0 compare unit
+    bool primary;                   // trigger pins and analysis modes
+    volatile bool started;
+    volatile bool finished;
+    uint32_t endMks;                // micros() of the gate end
+    bool timed;                     // gate is ended by the timer
+    bool finalPeriod;               // compare is moved to the end tick
+    uint8_t checkpointTicks;        // Timer0 periods since the last checkpoint
+
+    void saveCheckpoint();          // (interrupts disabled)
+};
+
+#endif
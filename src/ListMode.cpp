@@ -0,0 +1,160 @@
+#include "Arduino.h"
+#include "ListMode.h"
+
+void printGateStartRecord(uint16_t gate, uint32_t startMks, char source, uint16_t latencyMks,
+                          NeutronCounter *counters, uint8_t countersNumber)
+{
+  Serial.print(F("S,"));
+  Serial.print(gate);
+  Serial.print(',');
+  Serial.print(startMks);
+  Serial.print(',');
+  Serial.print(countersNumber);
+  for (uint8_t i = 0; i < countersNumber; i++)
+  {
+    Serial.print(',');
+    Serial.print(counters[i].timePerTick);
+    Serial.print(',');
+    Serial.print(counters[i].periodTicks);
+  }
+  Serial.print(',');
+  Serial.print(source);
+  Serial.print(',');
+  Serial.print(latencyMks);
+  Serial.print(',');
+  Serial.println(counters[0].intNum);
+}
+
+void printGateRecord(uint16_t gate, uint32_t liveMks, char endReason, uint32_t uncertaintyPpm,
+                     NeutronCounter *counters, uint8_t countersNumber)
+{
+  Serial.print(F("G,"));
+  Serial.print(gate);
+  Serial.print(',');
+  Serial.print(liveMks);
+  Serial.print(',');
+  Serial.print(countersNumber);
+  for (uint8_t i = 0; i < countersNumber; i++)
+  {
+    Serial.print(',');
+    Serial.print(counters[i].GetPulseNumber());
+    Serial.print(',');
+    Serial.print(counters[i].rejectedShort);
+    Serial.print(',');
+    Serial.print(counters[i].rejectedLong);
+  }
+  Serial.print(',');
+  Serial.print(endReason);
+  Serial.print(',');
+  Serial.print(uncertaintyPpm);
+  Serial.print(',');
+  Serial.println(counters[0].intNum);
+}
+
+void printRestartRecord(uint16_t gate, uint8_t interruptions, uint32_t lostMks)
+{
+  Serial.print(F("W,"));
+  Serial.print(gate);
+  Serial.print(',');
+  Serial.print(interruptions);
+  Serial.print(',');
+  Serial.println(lostMks);
+}
+
+#if LIST_MODE_ENABLED
+
+struct ListModeEvent
+{
+  uint32_t start;   // [mks] from gate start
+  uint32_t width;   // [ticks]
+  uint16_t period;  // primary gate Timer0 periods at the falling front
+  uint8_t channel;
+  uint8_t height;
+  char flag;
+};
+
+static volatile ListModeEvent events[LIST_MODE_BUFFER];
+static volatile uint8_t eventHead = 0;    // next event to write
+static volatile uint8_t eventCount = 0;   // events not printed yet
+static volatile uint16_t eventsLost = 0;  // buffer overflow
+static uint32_t originMks = 0;
+static volatile uint16_t periodNumber = 0;  // primary gate ticks since the start
+
+void listModeStart(uint32_t gateStartMks)
+{
+  uint8_t oldSREG = SREG;   // called from the gate (may be in ISR)
+  cli();
+  originMks = gateStartMks;
+  periodNumber = 0;
+  eventHead = 0;
+  eventCount = 0;
+  eventsLost = 0;
+  SREG = oldSREG;
+}
+
+// primary gate Timer0 tick (interrupts are disabled), before the Feynman-Y tick:
+// events of period p >= 1 are counted in Feynman-Y sub-gate feynmanSubGate(p, width)
+void listModeTick()
+{
+  ++periodNumber;
+}
+
+void listModePush(uint8_t channel, uint32_t startMks, uint32_t width, uint8_t height, char flag)
+{
+  if (eventCount >= LIST_MODE_BUFFER) { ++eventsLost; return;}
+  volatile ListModeEvent &e = events[eventHead];
+  e.start = startMks - originMks;
+  e.width = width;
+  e.period = periodNumber;
+  e.channel = channel;
+  e.height = height;
+  e.flag = flag;
+  eventHead = (eventHead + 1 < LIST_MODE_BUFFER) ? eventHead + 1 : 0;
+  ++eventCount;
+}
+
+void listModePrint()
+{
+  ListModeEvent e;
+  uint16_t lost;
+
+  while (true)
+  {
+    cli();
+    if (eventCount == 0) { sei(); break;}
+    uint8_t idx = (eventHead + LIST_MODE_BUFFER - eventCount) % LIST_MODE_BUFFER;
+    e.start = events[idx].start;
+    e.width = events[idx].width;
+    e.period = events[idx].period;
+    e.channel = events[idx].channel;
+    e.height = events[idx].height;
+    e.flag = events[idx].flag;
+    --eventCount;
+    sei();
+
+    Serial.print(F("E,"));
+    Serial.print(e.channel);
+    Serial.print(',');
+    Serial.print(e.start);
+    Serial.print(',');
+    Serial.print(e.width);
+    Serial.print(',');
+    Serial.print(e.height);
+    Serial.print(',');
+    Serial.print(e.flag);
+    Serial.print(',');
+    Serial.println(e.period);
+  }
+
+  cli();
+  lost = eventsLost;
+  eventsLost = 0;
+  sei();
+  if (lost > 0)
+  {
+    Serial.print(F("X,"));
+    Serial.println(lost);
+  }
+}
+
+#endif
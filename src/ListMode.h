@@ -0,0 +1,51 @@
+#ifndef ListMode_h
+#define ListMode_h
+
+// Machine readable Serial records (one per line, comma separated), parsed by the host tools:
+//
+//   S,<gate>,<gate start [mks since boot]>,<channels>,{<tick [1/256 mks]>,<ticks per count>} x channels,
+//     <started by: B == button, T == external trigger, C == campaign scheduler, R == repeated>,
+//     <start latency [mks], from the start request (trigger interrupt entry)>,<first channel>
+//   E,<channel>,<pulse start [mks from gate start]>,<width [ticks]>,<height>,<flag>,<count period>
+//       flag: A == accepted (adds width / period counts), S == too short, L == too long,
+//             H == rejected by height
+//       count period: primary gate Timer0 periods (ticks) before the falling front, when the
+//             counts are added (mod 2^16), Feynman-Y sub-gates are made of these periods
+//   X,<lost events>
+//   G,<gate>,<live time [mks]>,<channels>,{<counts>,<rejected short>,<rejected long>} x channels,
+//     <end: T == time, P == precision target, X == external>,<relative uncertainty [ppm]>,<first channel>
+//       first channel: 0 for the primary gate, 1 for the channel 1 gate (INDEPENDENT_GATES),
+//       gate numbers count separately per first channel
+//   C,<step>,<role: B == background, S == sample>,<live time [mks]>,<counts>,<rate [mcps]>,
+//     <rate sigma [mcps]>,<net rate (sample - pooled background) [mcps]>,<net sigma [mcps]>
+//   F,<gate>,<sub-gate width [mks]>,<sub-gates>,<counts in sub-gates>,<Feynman-Y [ppm]>
+//   W,<gate>,<resets during the gate>,<lost time [mks], upper bound>   (after G, warm restart only)
+//   R,<gate>,<pairs: S == same channel, C == cross channel>,<bin width [mks]>,<events>,
+//     <truncated events>,<bins>,{<pairs>} x bins   (streamed records are increments, sum them per gate)
+//
+// E records (list mode) are buffered by the channel handlers and printed from loop(),
+// their times are relative to the primary gate start.
+
+// SETUP
+#define LIST_MODE_ENABLED 0     // [0 or 1] stream E records, RAM: 13 bytes per buffered event
+#define LIST_MODE_BUFFER 16     // events buffered between two listModePrint() calls
+
+#define LIST_MODE_RAM (LIST_MODE_BUFFER * 13 + 10)  // [bytes] static buffer of ListMode.cpp
+
+#include "Arduino.h"
+#include "NeutronCounter.h"
+#include "PulseLogic.h"   // LM_ACCEPTED, LM_SHORT, LM_LONG, LM_HEIGHT
+
+void printGateStartRecord(uint16_t gate, uint32_t startMks, char source, uint16_t latencyMks,
+                          NeutronCounter *counters, uint8_t countersNumber);
+void printGateRecord(uint16_t gate, uint32_t liveMks, char endReason, uint32_t uncertaintyPpm,
+                     NeutronCounter *counters, uint8_t countersNumber);
+
+void printRestartRecord(uint16_t gate, uint8_t interruptions, uint32_t lostMks);
+
+void listModeStart(uint32_t gateStartMks);   // clear event buffer, set event time origin
+void listModeTick();                          // primary gate Timer0 tick (from ISR)
+void listModePush(uint8_t channel, uint32_t startMks, uint32_t width, uint8_t height, char flag);  // from ISR
+void listModePrint();                         // print buffered events
+
+#endif
@@ -0,0 +1,134 @@
+#include "Arduino.h"
+#include "Multiscaler.h"
+
+#if MULTISCALER_ENABLED
+
+Multiscaler::Multiscaler(NeutronCounter *counters, uint8_t countersNumber, uint16_t dwell_ticks)
+{
+  counter = counters;
+  counterNum = (countersNumber > MCS_MAX_CHANNELS) ? MCS_MAX_CHANNELS : countersNumber;
+  running = false;
+  setDwellTicks(dwell_ticks);
+  head = 0;
+  unread = 0;
+  overwritten = 0;
+  binNumber = 0;
+  lastBinTicks = 0;
+}
+
+void Multiscaler::setDwellTicks(uint16_t dwell_ticks)
+{
+  dwellTicks = (dwell_ticks == 0) ? 1 : dwell_ticks;
+}
+
+void Multiscaler::start()
+{
+  uint8_t oldSREG = SREG;   // called from the gate (may be in ISR)
+  cli();
+  head = 0;
+  unread = 0;
+  overwritten = 0;
+  binNumber = 0;
+  lastBinTicks = 0;
+  tickCount = 0;
+  aligned = false;
+  running = true;
+  SREG = oldSREG;
+}
+
+void Multiscaler::stop()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  if (running && aligned && tickCount > 0)
+  {
+    lastBinTicks = tickCount;
+    storeBin();
+  }
+  running = false;
+  SREG = oldSREG;
+}
+
+// Timer0 Compare B tick from the gate (interrupts are disabled)
+void Multiscaler::tick()
+{
+  if (!running) { return;}
+  if (!aligned)
+  {
+    // start the first bin on the Timer0 period boundary, so all bins have equal width
+    for (uint8_t i = 0; i < counterNum; i++) { lastCount[i] = counter[i].GetPulseNumber();}
+    aligned = true;
+    return;
+  }
+  if (++tickCount >= dwellTicks)
+  {
+    storeBin();
+  }
+}
+
+// close current bin (interrupts must be disabled)
+void Multiscaler::storeBin()
+{
+  for (uint8_t i = 0; i < counterNum; i++)
+  {
+    uint16_t count = counter[i].GetPulseNumber();
+    bins[head][i] = count - lastCount[i];
+    lastCount[i] = count;
+  }
+  head = (head + 1 < MCS_BINS) ? head + 1 : 0;
+  ++binNumber;
+  if (unread < MCS_BINS) { ++unread;}
+  else { ++overwritten;}  // the oldest bin was replaced
+  tickCount = 0;
+}
+
+void Multiscaler::printBins()
+{
+  uint16_t counts[MCS_MAX_CHANNELS];
+  uint16_t number;
+  uint16_t lost;
+
+  cli();
+  lost = overwritten;
+  overwritten = 0;
+  sei();
+  if (lost > 0)
+  {
+    Serial.print(F("MCS lost bins = "));
+    Serial.println(lost);
+  }
+
+  while (true)
+  {
+    cli();
+    if (unread == 0) { sei(); break;}
+    uint8_t idx = (head + MCS_BINS - unread) % MCS_BINS;
+    number = binNumber - unread;
+    for (uint8_t i = 0; i < counterNum; i++) { counts[i] = bins[idx][i];}
+    --unread;
+    bool partial = (!running && unread == 0 && lastBinTicks > 0);
+    sei();
+
+    Serial.print(F("MCS bin["));
+    Serial.print(number);
+    Serial.print(F("] t = "));
+    Serial.print((uint32_t)number * dwellTicks * T0_MKS_PER_PERIOD);
+    Serial.print(F(" mks"));
+    for (uint8_t i = 0; i < counterNum; i++)
+    {
+      Serial.print(F("  N"));
+      Serial.print(i);
+      Serial.print(F(" = "));
+      Serial.print(counts[i]);
+    }
+    if (partial)
+    {
+      Serial.print(F("  (dwell = "));
+      Serial.print((uint32_t)lastBinTicks * T0_MKS_PER_PERIOD);
+      Serial.print(F(" mks)"));
+    }
+    Serial.println();
+  }
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef Multiscaler_h
+#define Multiscaler_h
+
+// Multiscaler: time-resolved count profile within a gate.
+// Counts of every channel are binned into fixed dwell-time bins. Bins are switched
+// by the gate's Timer0 Compare B tick (Timer0 period == 1024 mks, the millis() timer
+// is not changed), so pulse handling gets no extra jitter.
+// Time offsets of the profile:
+// - a pulse is counted at its falling front, so it lands in the bin of its end:
+//   the profile lags the pulse starts by the pulse width (at least one count period, 6.46 ms);
+// - the printed t is measured from the first Compare B tick after the gate start,
+//   which comes 0 - 1024 mks after the gate start (counts before it are not binned).
+
+// SETUP
+#define MULTISCALER_ENABLED 0   // [0 or 1] RAM: 4 bytes per bin
+#define MCS_BINS 64             // ring size [bins], the oldest bins are overwritten
+#define MCS_DWELL_TICKS 10      // default dwell time [Timer0 periods] 10 * 1024 mks = 10.24 ms
+#define MCS_STREAM 0            // [0 or 1] print bins while counting, else dump after the gate
+#define MCS_MAX_CHANNELS 2
+
+#include "Arduino.h"
+#include "NeutronCounter.h"
+#include "FixedPoint.h"
+
+class Multiscaler
+{
+  public:
+    // Constructor
+    Multiscaler(NeutronCounter *counters, uint8_t countersNumber, uint16_t dwell_ticks);
+
+    void start();         // clear bins and start binning (call after NeutronCounter::startCounting)
+    void stop();          // stop binning, the last (partial) bin is stored
+    void tick();          // Timer0 Compare B tick (called by the gate)
+    void setDwellTicks(uint16_t dwell_ticks);  // dwell time [Timer0 periods], 1 - 65535
+    void printBins();     // print bins not printed yet
+
+    uint16_t dwellTicks;  // [Timer0 periods] bin width
+
+  private:
+    void storeBin();      // close current bin
+
+    NeutronCounter *counter;
+    uint8_t counterNum;
+
+    volatile uint16_t bins[MCS_BINS][MCS_MAX_CHANNELS];
+    volatile uint8_t head;          // next bin to write
+    volatile uint8_t unread;        // bins stored but not printed
+    volatile uint16_t overwritten;  // bins lost because of ring overflow
+    volatile uint16_t binNumber;    // index of the bin at head since start
+    volatile uint16_t lastBinTicks; // [Timer0 periods] width of the last (partial) bin
+
+    volatile bool running;
+    volatile bool aligned;          // first bin starts at the first Compare B after start()
+    uint16_t tickCount;
+    uint16_t lastCount[MCS_MAX_CHANNELS];
+};
+
+#endif
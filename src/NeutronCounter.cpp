@@ -1,32 +1,41 @@
 #include "Arduino.h"
-#include <math.h>
 #include "NeutronCounter.h"
+#include "FixedPoint.h"
+#include "ListMode.h"
+#include "RossiAlpha.h"
 
 extern NeutronCounter nCounter[];
 
-// Atmega328 Timer1 mks per tick for all available prescalers
-static double T1_mksFromPrescaler[6] = {0, 0.0625, 0.5, 4, 16, 64};
+// Atmega328 Timer1 tick length [1/256 mks] for T1_PRESCALER
+static constexpr mks_q8_t T1_MKS_Q8_PER_TICK = mksQ8PerTick(t1PrescalerDivider(T1_PRESCALER));
 
-// Atmega328 Timer2 mks per tick for all available prescalers
-static double T2_mksFromPrescaler[8] = {0, 0.0625, 0.5, 2, 4, 8, 16, 64};
+// Atmega328 Timer2 tick length [1/256 mks] for T2_PRESCALER
+static constexpr mks_q8_t T2_MKS_Q8_PER_TICK = mksQ8PerTick(t2PrescalerDivider(T2_PRESCALER));
 
-uint16_t regCountMax = 360;
-uint16_t registred0[360];
-uint16_t regCount0 = 0;
-uint16_t registred1[360];
-uint16_t regCount1 = 0;
-uint16_t t0Overflowed = 0;
-uint16_t t1Overflowed = 0;
+#if PULSE_HEIGHT_ENABLED
+volatile uint8_t adcCounter = 0;    // counter number of the running ADC conversion
+volatile uint8_t adcPending = 0;    // bit mask of counters waiting for the ADC
+#endif
 
-NeutronCounter::NeutronCounter(uint8_t pinNum, uint8_t interruptNum, uint32_t pulseTime)
+NeutronCounter::NeutronCounter(uint8_t pinNum, uint8_t interruptNum, uint8_t adc, uint32_t pulseTime)
 {
   pin = pinNum;
   intNum = interruptNum;
+  adcChannel = adc;
   pinMode(pin, INPUT);
   pulseAverageTime = pulseTime;
   pulseCounter = 0;
-  if (interruptNum == 0) {timePerTick = T1_mksFromPrescaler[T1_PRESCALER];}
-  else if (interruptNum == 1) {timePerTick = T2_mksFromPrescaler[T2_PRESCALER];}
+  pulseHeight = 0;
+  heightRejected = 0;
+  rejectedShort = 0;
+  rejectedLong = 0;
+  widthMin = N_WIDTH_MIN;
+  widthMax = N_WIDTH_MAX;
+  pulseStart = 0;
+  overflowed = 0;
+  regCount = 0;
+  if (interruptNum == 0) {timePerTick = T1_MKS_Q8_PER_TICK; periodTicks = T1_OCR1A + 1;}
+  else if (interruptNum == 1) {timePerTick = T2_MKS_Q8_PER_TICK; periodTicks = T2_OCR2A + 1;}
 }
 
 // set Timers registers
@@ -48,23 +57,46 @@ void NeutronCounter::init(){
     TCCR2A |= (1 << WGM21);   // set Timer2 CTC mode
     OCR2A = T2_OCR2A;
   }
+#if PULSE_HEIGHT_ENABLED
+  // ADC: AVcc reference (== DEFAULT), left adjusted 8bit result, conversion complete interrupt,
+  // prescaler 128 -> 125 kHz ADC clock (within the 50..200 kHz of the datasheet):
+  // the input is held 12 mks after the rising front, the result is ready after 104 mks,
+  // both far below the shortest counted pulse
+  ADMUX = (1 << REFS0) | (1 << ADLAR) | adcChannel;
+  ADCSRA = (1 << ADEN) | (1 << ADIE) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+  DIDR0 |= (1 << adcChannel);   // analog input: disable digital input buffer
+#endif
   sei();
 }
 
 // Timer1 Compare A interrupt handler
 ISR(TIMER1_COMPA_vect)
 {
-  ++t0Overflowed;
-  nCounter[0].increasePulseNumber();
+  ++nCounter[0].overflowed;   // pulses are counted at the falling front (see classifyPulse)
 }
 
 // Timer2 Compare A interrupt handler
 ISR(TIMER2_COMPA_vect)
 {
-  ++t1Overflowed;
-  nCounter[1].increasePulseNumber();
+  ++nCounter[1].overflowed;   // pulses are counted at the falling front (see classifyPulse)
 }
 
+#if PULSE_HEIGHT_ENABLED
+// ADC conversion complete interrupt handler
+ISR(ADC_vect)
+{
+  nCounter[adcCounter].pulseHeight = ADCH;  // 8bit left adjusted result
+  if (adcPending)
+  {
+    // the other channel's rising front came while the ADC was busy
+    adcCounter = (adcPending & 1) ? 0 : 1;
+    adcPending &= ~(1 << adcCounter);
+    ADMUX = (ADMUX & 0xF0) | nCounter[adcCounter].adcChannel;
+    ADCSRA |= (1 << ADSC);
+  }
+}
+#endif
+
 // stop interrupt handling
 void NeutronCounter::stopCounting(){
   detachInterrupt(intNum);  // stop external interrupt
@@ -85,6 +117,7 @@ void NeutronCounter::stopCounting(){
 
 // start interrupt handling
 void NeutronCounter::startCounting(){
+  uint8_t oldSREG = SREG;   // may be called from ISR (external trigger)
   cli();
   // reAttachInterrupt(intNum, SIGNAL_START_EDGE);
   if (intNum == 0)
@@ -99,7 +132,35 @@ void NeutronCounter::startCounting(){
     attachInterrupt(1, nSignalHandler1, SIGNAL_START_EDGE);
     TCCR2B |= (T2_PRESCALER << CS20);    // set Timer2 prescaler 8x (b010) and start Timer2 
   }
-  sei();
+  SREG = oldSREG;
+}
+
+// width discrimination of the finished pulse (called at the falling front)
+// returns the verdict, the pulse is counted if it is LM_ACCEPTED (see pulseCounts())
+char NeutronCounter::classifyPulse(uint32_t width)
+{
+#if PULSE_HEIGHT_ENABLED
+  char verdict = pulseVerdict(width, pulseHeight, widthMin, widthMax, PH_LLD);
+#else
+  char verdict = pulseVerdict(width, 0, widthMin, widthMax, 0);
+#endif
+  if (verdict == LM_SHORT) { ++rejectedShort;}
+  else if (verdict == LM_LONG) { ++rejectedLong;}
+  else if (verdict == LM_HEIGHT) { ++heightRejected;}
+#if LIST_MODE_ENABLED
+  listModePush(intNum, pulseStart, width, pulseHeight, verdict);
+#endif
+#if ROSSI_ENABLED
+  if (verdict == LM_ACCEPTED) { rossiPush(intNum, pulseStart);}
+#endif
+  return verdict;
+}
+
+// set width discrimination window [ticks], both limits are included
+void NeutronCounter::setWidthWindow(uint32_t minTicks, uint32_t maxTicks)
+{
+  widthMin = minTicks;
+  widthMax = maxTicks;
 }
 
 void NeutronCounter::increasePulseNumber(uint16_t n)
@@ -107,16 +168,34 @@ void NeutronCounter::increasePulseNumber(uint16_t n)
   pulseCounter += n;
 }
 
+// log the accepted pulse (called at the falling front), the log is full at REG_COUNT_MAX
+void NeutronCounter::registerPulse(uint32_t width)
+{
+  if (regCount >= REG_COUNT_MAX) { return;}
+  registred[regCount] = (width > 0xFFFF) ? 0xFFFF : width;   // widthMax may be above 16 bits
+#if PULSE_HEIGHT_ENABLED
+  amplitude[regCount] = pulseHeight;
+#endif
+  ++regCount;
+}
+
+void NeutronCounter::setPulseNumber(uint16_t n)
+{
+  pulseCounter = n;
+}
+
 void NeutronCounter::flush()
 {
   // timerOVF = 0; // delete
   pulseCounter = 0;
   signalContinues = false;
+  pulseHeight = 0;
+  heightRejected = 0;
+  rejectedShort = 0;
+  rejectedLong = 0;
 
-  regCount0 = 0;
-  regCount1 = 0;
-  t0Overflowed = 0;
-  t1Overflowed = 0;
+  regCount = 0;
+  overflowed = 0;
 
   // if (intNum == 0)
   // {
@@ -141,12 +220,11 @@ void nSignalHandler0()
 {
   if (nCounter[0].signalContinues)
   {
-    if (regCount0 < regCountMax)
-    {
-      registred0[regCount0] = TCNT1;
-      registred0[regCount0] += (T1_OCR1A + 1) * t0Overflowed;
-      ++regCount0;
-    }
+    uint16_t periods = nCounter[0].overflowed;
+    uint32_t width = pulseWidth(TCNT1, periods, T1_OCR1A + 1);   // [ticks]
+    char verdict = nCounter[0].classifyPulse(width);
+    nCounter[0].increasePulseNumber(pulseCounts(verdict, periods));
+    if (verdict == LM_ACCEPTED) { nCounter[0].registerPulse(width);}
     // signal's tail detected (end of the signal)
     TIMSK1 &= ~(1 << OCIE1A);                                 // turn off Timer1 Compare A Match Interrupt
     // TIMSK1 &= ~(1 << TOIE1);                                  // turn off Timer1 overflow Interrupt
@@ -165,7 +243,13 @@ void nSignalHandler0()
     nCounter[0].signalContinues = true;  
     reAttachInterrupt(nCounter[0].intNum, SIGNAL_END_EDGE);   // serch for falling front (end of the signal)
 
-    t0Overflowed = 0;
+    nCounter[0].overflowed = 0;
+#if PULSE_HEIGHT_ENABLED
+    requestPulseHeight(0);
+#endif
+#if (LIST_MODE_ENABLED || ROSSI_ENABLED)
+    nCounter[0].pulseStart = micros();
+#endif
   }
 }
 
@@ -174,12 +258,11 @@ void nSignalHandler1()
 {
   if (nCounter[1].signalContinues)
   {
-    if (regCount1 < regCountMax)
-    {
-      registred1[regCount1] = TCNT2;
-      registred1[regCount1] += (T2_OCR2A + 1) * t1Overflowed;
-      ++regCount1;
-    }
+    uint16_t periods = nCounter[1].overflowed;
+    uint32_t width = pulseWidth(TCNT2, periods, T2_OCR2A + 1);   // [ticks]
+    char verdict = nCounter[1].classifyPulse(width);
+    nCounter[1].increasePulseNumber(pulseCounts(verdict, periods));
+    if (verdict == LM_ACCEPTED) { nCounter[1].registerPulse(width);}
     // falling front detected (end of the signal)
     TIMSK2 &= ~(1 << OCIE2A);                                   // turn off Timer2 Compare A Match Interrupt
     TIMSK2 &= ~(1 << TOIE2);                                    // turn off Timer2 Overflow Interrupt
@@ -198,10 +281,35 @@ void nSignalHandler1()
     nCounter[1].signalContinues = true;
     reAttachInterrupt(nCounter[1].intNum, SIGNAL_END_EDGE);   // serch for falling front (end of the signal)
 
-    t1Overflowed = 0;
+    nCounter[1].overflowed = 0;
+#if PULSE_HEIGHT_ENABLED
+    requestPulseHeight(1);
+#endif
+#if (LIST_MODE_ENABLED || ROSSI_ENABLED)
+    nCounter[1].pulseStart = micros();
+#endif
   }
 }
 
+#if PULSE_HEIGHT_ENABLED
+// start ADC conversion of the counter's analog input (no waiting),
+// the result is stored to pulseHeight by ADC_vect
+void requestPulseHeight(uint8_t counterNum)
+{
+  nCounter[counterNum].pulseHeight = 0;
+  // ADC is busy while converting (ADSC) and until ADC_vect has stored the result (ADIF):
+  // INT0/INT1 outrank ADC_vect, a new conversion would take the result of the other channel
+  if (ADCSRA & ((1 << ADSC) | (1 << ADIF)))
+  {
+    adcPending |= (1 << counterNum);  // start after current conversion
+    return;
+  }
+  adcCounter = counterNum;
+  ADMUX = (ADMUX & 0xF0) | nCounter[counterNum].adcChannel;
+  ADCSRA |= (1 << ADSC);
+}
+#endif
+
 // attach interrupt without any changes to interrupt handling function
 void reAttachInterrupt(uint8_t interruptNum, int mode) {
   switch(interruptNum){
@@ -220,81 +328,74 @@ void reAttachInterrupt(uint8_t interruptNum, int mode) {
   }
 }
 
-void printNeutronStats()
+void printNeutronStats(NeutronCounter *counters, uint8_t countersNumber)
 {
-  uint16_t minWidth = -1;
-  uint16_t maxWidth = 0;
-  double averageWidth = 0;
-  uint16_t threshold = 20;
-  uint16_t count = 0;
+  uint16_t total = 0;
 
-  Serial.println("======================================");
-  Serial.println("------------  STATISTICS  ------------");
-  Serial.println("======================================");
-  for (int i = 0; i < regCount0; i++)
+  Serial.println(F("======================================"));
+  Serial.println(F("------------  STATISTICS  ------------"));
+  Serial.println(F("======================================"));
+  for (uint8_t i = 0; i < countersNumber; i++)
   {
-    Serial.print("N0 signal[");
-    Serial.print(i);
-    Serial.print("] width = ");
-    Serial.println(registred0[i]);
-    if (registred0[i] > threshold)
-    {
-      minWidth = (minWidth > registred0[i]) ? registred0[i] : minWidth;
-      maxWidth = (maxWidth < registred0[i]) ? registred0[i] : maxWidth;
-      averageWidth += registred0[i];
-      ++count;
-    }
-    
+    counters[i].printStats();
+    total += counters[i].regCount;
+    Serial.println(F("---------------------------------------"));
+    if (i + 1 < countersNumber) { Serial.println();}
   }
-  averageWidth /= count;
+  Serial.print(F("TOTAL pulse number = "));
+  Serial.print(total);
+  Serial.println();
+}
 
-  Serial.println("");
-  Serial.print("Min = ");
-  Serial.print(minWidth);
-  Serial.print("  Avr = ");
-  Serial.print(averageWidth, 2);
-  Serial.print("  Max = ");
-  Serial.println(maxWidth);
-  Serial.print("Timer1 overflowed >> ");
-  Serial.print(t0Overflowed);
-  Serial.println(" << times.");
-  Serial.println("---------------------------------------");
-  Serial.println("");
-
-  minWidth = -1;
-  maxWidth = 0;
-  averageWidth = 0;
-  count = 0;
-
-  for (int i = 0; i < regCount1; i++)
+void NeutronCounter::printStats()
+{
+  uint16_t minWidth = -1;
+  uint16_t maxWidth = 0;
+  uint32_t sumWidth = 0;
+  uint16_t count = 0;
+
+  for (int i = 0; i < regCount; i++)
   {
-    Serial.print("N1 signal[");
+    Serial.print('N');
+    Serial.print(intNum);
+    Serial.print(F(" signal["));
     Serial.print(i);
-    Serial.print("] width = ");
-    Serial.println(registred1[i]);
-    if (registred1[i] > threshold)
-    {
-      minWidth = (minWidth > registred1[i]) ? registred1[i] : minWidth;
-      maxWidth = (maxWidth < registred1[i]) ? registred1[i] : maxWidth;
-      averageWidth += registred1[i];
-      ++count;
-    }
+    Serial.print(F("] width = "));
+#if PULSE_HEIGHT_ENABLED
+    Serial.print(registred[i]);
+    Serial.print(F("  height = "));
+    Serial.println(amplitude[i]);
+#else
+    Serial.println(registred[i]);
+#endif
+    // noise is rejected by the width window before registration
+    minWidth = (minWidth > registred[i]) ? registred[i] : minWidth;
+    maxWidth = (maxWidth < registred[i]) ? registred[i] : maxWidth;
+    sumWidth += registred[i];
+    ++count;
   }
-  averageWidth /= count;
 
-  Serial.println("");
-  Serial.print("Min = ");
+  Serial.println();
+  Serial.print(F("Min = "));
   Serial.print(minWidth);
-  Serial.print("  Avr = ");
-  Serial.print(averageWidth, 2);
-  Serial.print("  Max = ");
-  Serial.println(maxWidth);
-  Serial.print("Timer2 overflowed >> ");
-  Serial.print(t1Overflowed);
-  Serial.println(" << times.");
-  Serial.println("---------------------------------------");
-  Serial.print("TOTAL pulse number = ");
-  Serial.print(regCount0 + regCount1);
-  Serial.println("");
-  
+  Serial.print(F("  Avr = "));
+  printFixed(Serial, count ? (sumWidth * 100 + count / 2) / count : 0, 2);
+  Serial.print(F("  Max = "));
+  Serial.print(maxWidth);
+  Serial.print(F("  (Avr = "));
+  Serial.print(count ? ticksToMks(sumWidth, timePerTick) / count : 0);
+  Serial.println(F(" mks)"));
+  Serial.print(F("Timer"));
+  Serial.print(intNum + 1);
+  Serial.print(F(" overflowed >> "));
+  Serial.print(overflowed);
+  Serial.println(F(" << times."));
+  Serial.print(F("Rejected short = "));
+  Serial.print(rejectedShort);
+  Serial.print(F("  long = "));
+  Serial.println(rejectedLong);
+#if (PULSE_HEIGHT_ENABLED && PH_LLD > 0)
+  Serial.print(F("Rejected by height = "));
+  Serial.println(heightRejected);
+#endif
 }
@@ -17,31 +17,67 @@
 #define T2_PRESCALER 7      // 7 == b111 stands for 1024 prescaler
 #define T2_OCR2A 100         // Timer2 Compare A value [8bit] = 86 * (1 / 16MHz / 1024) = 5504 mks period
 
+// N_WIDTH_MIN, N_WIDTH_MAX, PH_LLD: see PulseLogic.h (shared with the host tools)
+
+#define PULSE_HEIGHT_ENABLED 1  // sample pulse amplitude (A2/A3) at the rising front [0 or 1]
+
+#if PULSE_HEIGHT_ENABLED
+#define REG_COUNT_MAX 240   // max registred pulses per channel (widths + heights)
+#else
+#define REG_COUNT_MAX 360   // max registred pulses per channel (widths)
+#endif
+
 #include "Arduino.h"
+#include "FixedPoint.h"
+#include "PulseLogic.h"
 
 class NeutronCounter
 {
   public:
     // Constructor
-    NeutronCounter(uint8_t pin_num, uint8_t interruptNum, uint32_t pulse_time);
+    NeutronCounter(uint8_t pin_num, uint8_t interruptNum, uint8_t adc_channel, uint32_t pulse_time);
 
     void init();          // set Timers registers (need to execute once before using NeutronCounter)
     void stopCounting();  // stop ext interrupt handling
     void startCounting(); // start ext interrupt handling
     void flush();         // reset counter
     void increasePulseNumber(uint16_t n=1);   // increase pulseCounter by value
+    void setPulseNumber(uint16_t n);          // restore pulseCounter (warm restart)
+    char classifyPulse(uint32_t width);       // width (and height) verdict of the finished pulse (PulseLogic.h)
+    void registerPulse(uint32_t width);       // log the accepted pulse width (and height) for printStats()
+    void printStats();                        // registred pulses and rejections (debug)
+    void setWidthWindow(uint32_t minTicks, uint32_t maxTicks);  // set accepted pulse width window [ticks]
 
     uint16_t GetPulseNumber();  // returns pulseNumber
     
     uint8_t pin;    // digital input pin (interrupt pin)
     int intNum;     // interrupt number
     
-    double timePerTick;         // time in mks per timer tick
+    mks_q8_t timePerTick;       // [1/256 mks] time per timer tick
+    uint16_t periodTicks;       // [ticks] timer compare period, one count per full period
     uint32_t pulseAverageTime;  // [mks] time of single pulse max=4294967296 mks (~71.5 minutes)
 
     bool signalContinues;   // means the rising front (start) of the signal have been detected, 
     // and the falling front (end) of the signal is still not detected
 
+    volatile uint32_t pulseStart;   // [mks] micros() at the rising front (list mode, Rossi-alpha)
+
+    uint8_t adcChannel;             // ADC input sampled at the rising front
+    volatile uint8_t pulseHeight;   // [8bit ADC code] amplitude of the current (last) pulse
+    volatile uint16_t heightRejected; // pulses rejected by PH_LLD
+
+    uint32_t widthMin;                // [ticks] width discrimination window (limits included)
+    uint32_t widthMax;
+    volatile uint16_t rejectedShort;  // pulses shorter than widthMin
+    volatile uint16_t rejectedLong;   // pulses longer than widthMax
+
+    volatile uint16_t overflowed;     // timer compare periods of the current pulse
+    uint16_t registred[REG_COUNT_MAX];  // widths of the accepted pulses [ticks], clamped to 0xFFFF
+#if PULSE_HEIGHT_ENABLED
+    uint8_t amplitude[REG_COUNT_MAX];   // pulse heights, same index as registred
+#endif
+    uint16_t regCount;
+
     // bool have_new = false;
     // uint8_t reg_info = 0;
     // uint32_t ovf_info = 0;
@@ -54,15 +90,18 @@ class NeutronCounter
 
 void nSignalHandler0();   // External interrupt INT0 handler
 void nSignalHandler1();   // External interrupt INT1 handler
-void printNeutronStats();        // debug
+void requestPulseHeight(uint8_t counterNum);  // start (or queue) ADC conversion for the counter's analog input
+void printNeutronStats(NeutronCounter *counters, uint8_t countersNumber);  // debug
 
 void reAttachInterrupt(uint8_t interruptNum, int mode);  // attach interrupt without any changes to interrupt handling function
 
+// pulse height inputs: N1_ANALOG_PIN and N2_ANALOG_PIN (main.cpp)
 #if (N_COUNTERS_NUMBER == 1)
-// NeutronCounter(uint8_t pin_num, uint8_t interruptNum, unsigned int pulse_time);
-NeutronCounter nCounter[N_COUNTERS_NUMBER] {{INT0_PIN, INT0, PULSE_TIME}};
+// NeutronCounter(uint8_t pin_num, uint8_t interruptNum, uint8_t adc_channel, unsigned int pulse_time);
+NeutronCounter nCounter[N_COUNTERS_NUMBER] {{INT0_PIN, INT0, N1_ANALOG_PIN - A0, PULSE_TIME}};
 #elif (N_COUNTERS_NUMBER == 2)
-NeutronCounter nCounter[N_COUNTERS_NUMBER] {{INT0_PIN, INT0, PULSE_TIME}, {INT1_PIN, INT1, PULSE_TIME}};
+NeutronCounter nCounter[N_COUNTERS_NUMBER] {{INT0_PIN, INT0, N1_ANALOG_PIN - A0, PULSE_TIME},
+                                            {INT1_PIN, INT1, N2_ANALOG_PIN - A0, PULSE_TIME}};
 #endif
 
 #endif
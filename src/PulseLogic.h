@@ -0,0 +1,53 @@
+#ifndef PulseLogic_h
+#define PulseLogic_h
+
+// Pulse discrimination and counting rules of the channel handlers.
+// Plain C++ (no Arduino core), so the host tools (tools/nc_analyze) compile
+// the same rules and can check recorded streams against the firmware results.
+
+// An accepted pulse adds one count per full timer compare period (pulseCounts()),
+// so a pulse shorter than one period (101 ticks) adds nothing: a window minimum below
+// the period only sorts such pulses into A (0 counts) and S (list mode, statistics).
+
+// SETUP
+#define N_WIDTH_MIN 101      // [ticks] shortest counted pulse, one compare period 101 * 64 mks = 6464 mks
+#define N_WIDTH_MAX 65535    // [ticks] longest counted pulse, 65535 * 64 mks = 4.2 s
+#define PH_LLD 0             // lower level discriminator [8bit ADC code], pulses below it are not counted (0 == off)
+
+#include <stdint.h>
+
+// pulse verdicts (list mode E record flags)
+#define LM_ACCEPTED 'A'
+#define LM_SHORT 'S'
+#define LM_LONG 'L'
+#define LM_HEIGHT 'H'
+
+// verdict for the finished pulse: width window [ticks] (limits included), then height >= lld (0 == off)
+inline char pulseVerdict(uint32_t width, uint8_t height, uint32_t widthMin, uint32_t widthMax, uint8_t lld)
+{
+  if (width < widthMin) { return LM_SHORT;}
+  if (width > widthMax) { return LM_LONG;}
+  if (lld > 0 && height < lld) { return LM_HEIGHT;}   // gamma or noise pulse
+  return LM_ACCEPTED;
+}
+
+// pulse width [ticks] at the falling front: timer count plus the compare periods
+// counted by the compare interrupt during the pulse (timerCount < periodTicks)
+inline uint32_t pulseWidth(uint16_t timerCount, uint16_t periods, uint16_t periodTicks)
+{
+  return timerCount + (uint32_t)periodTicks * periods;
+}
+
+// compare periods of a recorded width (host side inverse of pulseWidth())
+inline uint16_t pulsePeriods(uint32_t width, uint16_t periodTicks)
+{
+  return (uint16_t)(width / periodTicks);
+}
+
+// counts added by the finished pulse: one per full compare period, accepted pulses only
+inline uint16_t pulseCounts(char verdict, uint16_t periods)
+{
+  return (verdict == LM_ACCEPTED) ? periods : 0;
+}
+
+#endif
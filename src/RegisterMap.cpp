@@ -0,0 +1,121 @@
+#include "Arduino.h"
+#include "RegisterMap.h"
+#include "FixedPoint.h"
+
+#if REGMAP_ENABLED
+
+extern RegisterMap regMap;
+
+// TWI slave status codes (TWSR & 0xF8)
+#define TW_SR_SLA_ACK 0x60        // own SLA+W received
+#define TW_SR_DATA_ACK 0x80       // data byte received
+#define TW_SR_DATA_NACK 0x88
+#define TW_SR_STOP 0xA0           // STOP or repeated START
+#define TW_ST_SLA_ACK 0xA8        // own SLA+R received
+#define TW_ST_DATA_ACK 0xB8       // data byte sent, master wants more
+#define TW_ST_DATA_NACK 0xC0      // data byte sent, master is done
+#define TW_ST_LAST_DATA 0xC8
+#define TW_BUS_ERROR 0x00
+
+#define TWCR_ACK ((1 << TWINT) | (1 << TWEA) | (1 << TWEN) | (1 << TWIE))
+
+RegisterMap::RegisterMap(CountingGate *countingGate, NeutronCounter *counters, uint8_t countersNumber)
+{
+  gate = countingGate;
+  counter = counters;
+  counterNum = (countersNumber > REGMAP_MAX_CHANNELS) ? REGMAP_MAX_CHANNELS : countersNumber;
+  front = 0;
+  reading = 0;
+  busy = false;
+  pointer = 0;
+  pointerSet = false;
+  sequence = 0;
+  memset(snapshot, 0, sizeof(snapshot));
+}
+
+void RegisterMap::init(uint8_t address)
+{
+  update();
+  uint8_t oldSREG = SREG;
+  cli();
+  TWAR = address << 1;              // no general call
+  TWCR = (1 << TWEA) | (1 << TWEN) | (1 << TWIE);
+  SREG = oldSREG;
+}
+
+// TWI interrupt handler
+ISR(TWI_vect)
+{
+  regMap.twiEvent();
+}
+
+// fill the back buffer and flip (called from loop(), counters are read in one short cli())
+void RegisterMap::update()
+{
+  uint8_t back = front ^ 1;
+  if (busy && back == reading) { return;}   // a slow read still uses it, try next time
+
+  RegisterMapData &s = snapshot[back];
+  const RegisterMapData &last = snapshot[front];
+  cli();
+  bool keep = gate->armed;   // counters are flushed at arm(): keep the counts of the last gate
+  for (uint8_t i = 0; i < counterNum; i++)
+  {
+    s.counts[i] = keep ? last.counts[i] : counter[i].GetPulseNumber();
+    s.rejectedShort[i] = keep ? last.rejectedShort[i] : counter[i].rejectedShort;
+    s.rejectedLong[i] = keep ? last.rejectedLong[i] : counter[i].rejectedLong;
+  }
+  s.state = (gate->armed ? REGMAP_ARMED : 0) | (gate->active ? REGMAP_ACTIVE : 0);
+  s.endReason = gate->endReason;
+  s.source = gate->source;
+  s.gate = gate->number;
+  s.liveMks = gate->liveMks();
+  sei();
+
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < counterNum; i++) { total += s.counts[i];}
+  s.id = REGMAP_ID;
+  s.sequence = ++sequence;
+  s.channels = counterNum;
+  s.rateMcps = rateMilliCps(total, s.liveMks);
+  s.uncertaintyPpm = relUncertaintyPpm(total);
+  front = back;   // single byte write: the next read gets the new snapshot
+}
+
+void RegisterMap::twiEvent()
+{
+  switch (TWSR & 0xF8)
+  {
+    case TW_SR_SLA_ACK:
+      pointerSet = false;
+      break;
+    case TW_SR_DATA_ACK:
+    case TW_SR_DATA_NACK:
+      if (!pointerSet)
+      {
+        pointer = TWDR;
+        pointerSet = true;
+      }
+      break;
+    case TW_ST_SLA_ACK:
+      reading = front;
+      busy = true;
+      // fall through
+    case TW_ST_DATA_ACK:
+      TWDR = (pointer < sizeof(RegisterMapData)) ? ((const uint8_t *)&snapshot[reading])[pointer] : 0xFF;
+      if (pointer < 0xFF) { ++pointer;}
+      break;
+    case TW_SR_STOP:
+    case TW_ST_DATA_NACK:
+    case TW_ST_LAST_DATA:
+      busy = false;
+      break;
+    case TW_BUS_ERROR:
+      busy = false;
+      TWCR = TWCR_ACK | (1 << TWSTO);   // release the bus
+      return;
+  }
+  TWCR = TWCR_ACK;
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef RegisterMap_h
+#define RegisterMap_h
+
+// TWI (I2C) slave register map for host / PLC polling of the live counts.
+// Many boards share one bus (A4 == SDA, A5 == SCL, external pull-ups), each
+// with its own REGMAP_TWI_ADDRESS.
+//
+// Protocol: write one byte == register address, then read any number of bytes
+// (repeated START or a new transaction), the address auto-increments, bytes
+// past the map read 0xFF. Multi-byte values are little endian.
+//
+//   0x00  id                  REGMAP_ID
+//   0x01  sequence            snapshot number, changes on every refresh
+//   0x02  state               bit0 armed, bit1 active
+//   0x03  end reason          of the last gate: T == time, P == precision target, X == external
+//   0x04  gate          [2]   gate number since power on
+//   0x06  channels
+//   0x07  source              B == button, T == trigger, C == campaign
+//   0x08  live time     [4]   [mks] of the running (or last) gate
+//   0x0C  rate          [4]   [1/1000 cps] total count rate
+//   0x10  uncertainty   [4]   [ppm] Poisson relative uncertainty of the total count
+//   0x14  counts        [2]x2 per channel, of the running (or last) gate
+//   0x18  short         [2]x2 rejected short pulses per channel
+//   0x1C  long          [2]x2 rejected long pulses per channel
+//
+// Snapshots are double buffered: loop() fills the back buffer and flips, the
+// TWI interrupt only sends bytes of the front buffer latched at SLA+R, so a
+// read is coherent and the counter ISRs are never blocked by the bus.
+
+// SETUP
+#define REGMAP_ENABLED 0        // [0 or 1] RAM: 75 bytes
+#define REGMAP_TWI_ADDRESS 0x40 // 7 bit slave address, unique on the bus
+
+#include "Arduino.h"
+#include "NeutronCounter.h"
+#include "Gate.h"
+
+#define REGMAP_ID 0x4E          // 'N'
+#define REGMAP_MAX_CHANNELS 2
+
+#define REGMAP_ARMED 0x01
+#define REGMAP_ACTIVE 0x02
+
+struct RegisterMapData
+{
+  uint8_t id;
+  uint8_t sequence;
+  uint8_t state;
+  char endReason;
+  uint16_t gate;
+  uint8_t channels;
+  char source;
+  uint32_t liveMks;
+  uint32_t rateMcps;
+  uint32_t uncertaintyPpm;
+  uint16_t counts[REGMAP_MAX_CHANNELS];
+  uint16_t rejectedShort[REGMAP_MAX_CHANNELS];
+  uint16_t rejectedLong[REGMAP_MAX_CHANNELS];
+};
+
+class RegisterMap
+{
+  public:
+    // Constructor
+    RegisterMap(CountingGate *countingGate, NeutronCounter *counters, uint8_t countersNumber);
+
+    void init(uint8_t address);   // start TWI slave
+    void update();                // refresh the snapshot (call from loop())
+    void twiEvent();              // TWI interrupt handler
+
+  private:
+    CountingGate *gate;
+    NeutronCounter *counter;
+    uint8_t counterNum;
+
+    RegisterMapData snapshot[2];
+    volatile uint8_t front;       // snapshot served to new reads
+    volatile uint8_t reading;     // snapshot latched by the running read
+    volatile bool busy;           // read transaction in progress
+    volatile uint8_t pointer;     // register address
+    volatile bool pointerSet;     // first byte of a write is the register address
+    uint8_t sequence;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include "Arduino.h"
+#include "RossiAlpha.h"
+
+#if ROSSI_ENABLED
+
+// accessed with interrupts disabled only (channel handlers, cli() sections)
+static RossiState rossi;
+
+void rossiStart()
+{
+  uint8_t oldSREG = SREG;   // called from the gate (may be in ISR)
+  cli();
+  rossiClear(rossi);
+  SREG = oldSREG;
+}
+
+void rossiPush(uint8_t channel, uint32_t startMks)
+{
+  rossiPair(rossi, channel, startMks);
+}
+
+// R,<gate>,<pairs: S == same channel, C == cross channel>,<bin width [mks]>,<events>,<truncated events>,
+//   <bins>,{<pairs>} x bins
+void rossiPrint(uint16_t gateNumber)
+{
+  uint16_t counts[RA_BINS];
+  uint16_t events;
+  uint16_t lost;
+
+  cli();
+  events = rossi.eventNumber;
+  lost = rossi.truncated;
+  rossi.eventNumber = 0;
+  rossi.truncated = 0;
+  sei();
+
+  for (uint8_t type = RA_SAME; type <= RA_CROSS; type++)
+  {
+    cli();
+    for (uint8_t i = 0; i < RA_BINS; i++)
+    {
+      counts[i] = rossi.histogram[type][i];
+      rossi.histogram[type][i] = 0;
+    }
+    sei();
+
+    Serial.print(F("R,"));
+    Serial.print(gateNumber);
+    Serial.print(',');
+    Serial.print(type == RA_SAME ? 'S' : 'C');
+    Serial.print(',');
+    Serial.print(1UL << RA_BIN_SHIFT);
+    Serial.print(',');
+    Serial.print(events);
+    Serial.print(',');
+    Serial.print(lost);
+    Serial.print(',');
+    Serial.print(RA_BINS);
+    for (uint8_t i = 0; i < RA_BINS; i++)
+    {
+      Serial.print(',');
+      Serial.print(counts[i]);
+    }
+    Serial.println();
+  }
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef RossiAlpha_h
+#define RossiAlpha_h
+
+// Rossi-alpha distribution: histogram of time differences between every accepted
+// event and the earlier events inside the window (RA_BINS * bin width), separately
+// for same-channel and cross-channel pairs. Event time == pulse start (micros()).
+//
+// RAM and CPU are bounded by the trailing history: an event is paired with at most
+// RA_HISTORY previous events. If the oldest event in the history is still inside the
+// window the event is counted as truncated (pairs are lost, raise RA_HISTORY or
+// lower the window).
+//
+// An accepted pulse lasts at least one count period (101 * 64 mks = 6.46 ms) and a
+// channel sees one pulse at a time, so same-channel pulse starts are at least 6.46 ms
+// apart: same-channel bins below 6.46 ms stay empty, the window must be longer than that.
+
+// SETUP
+#define ROSSI_ENABLED 0         // [0 or 1] RAM: 4 bytes per bin + 5 bytes per history event
+#define RA_BINS 32              // bins per histogram
+#define RA_BIN_SHIFT 8          // bin width == 2^RA_BIN_SHIFT mks (256 mks, window 8192 mks)
+#define RA_HISTORY 8            // trailing events paired with each new event
+#define RA_STREAM 0             // [0 or 1] print (and clear) histograms while counting, else dump after the gate
+#define RA_STREAM_PERIOD 1000   // [ms] stream print period
+
+#include <stdint.h>
+
+#define RA_SAME 0
+#define RA_CROSS 1
+#define RA_WINDOW_MKS ((uint32_t)RA_BINS << RA_BIN_SHIFT)
+
+// Histograms and trailing history. Plain C++ (no Arduino core): the host tools
+// (tools/nc_analyze) replay list mode events through the same rossiPair().
+struct RossiState
+{
+  uint16_t histogram[2][RA_BINS];   // [RA_SAME / RA_CROSS][bin], saturated at 0xFFFF
+  uint32_t historyStart[RA_HISTORY];  // [mks]
+  uint8_t historyChannel[RA_HISTORY];
+  uint8_t historyHead;    // next event to write
+  uint8_t historyCount;
+  uint16_t eventNumber;   // events since the last print
+  uint16_t truncated;     // events with pairs beyond the history
+};
+
+inline void rossiClear(RossiState &s)
+{
+  for (uint8_t i = 0; i < RA_BINS; i++)
+  {
+    s.histogram[RA_SAME][i] = 0;
+    s.histogram[RA_CROSS][i] = 0;
+  }
+  s.historyHead = 0;
+  s.historyCount = 0;
+  s.eventNumber = 0;
+  s.truncated = 0;
+}
+
+// Channel handlers accept pulses at the falling front, so pulse starts of different
+// channels may come out of order: time differences are taken as absolute values.
+inline uint32_t rossiDistance(uint32_t aMks, uint32_t bMks)
+{
+  int32_t dt = (int32_t)(aMks - bMks);
+  return (dt < 0) ? (uint32_t)-dt : (uint32_t)dt;
+}
+
+inline void rossiPair(RossiState &s, uint8_t channel, uint32_t startMks)
+{
+  uint8_t idx = s.historyHead;
+  for (uint8_t k = 0; k < s.historyCount; k++)
+  {
+    idx = (idx > 0) ? idx - 1 : RA_HISTORY - 1;   // newest first
+    uint32_t dt = rossiDistance(startMks, s.historyStart[idx]);
+    if (dt >= RA_WINDOW_MKS) { continue;}
+    uint16_t &bin = s.histogram[(s.historyChannel[idx] == channel) ? RA_SAME : RA_CROSS][dt >> RA_BIN_SHIFT];
+    if (bin < 0xFFFF) { ++bin;}
+  }
+  if (s.historyCount == RA_HISTORY)
+  {
+    // the event to be replaced is the oldest one, it is still in the window == pairs were lost
+    if (rossiDistance(startMks, s.historyStart[s.historyHead]) < RA_WINDOW_MKS) { ++s.truncated;}
+  }
+  else { ++s.historyCount;}
+  s.historyStart[s.historyHead] = startMks;
+  s.historyChannel[s.historyHead] = channel;
+  s.historyHead = (s.historyHead + 1 < RA_HISTORY) ? s.historyHead + 1 : 0;
+  ++s.eventNumber;
+}
+
+void rossiStart();                                   // clear histograms and history (gate start)
+void rossiPush(uint8_t channel, uint32_t startMks);  // accepted event (from ISR)
+void rossiPrint(uint16_t gateNumber);                // print R records, histograms are cleared
+
+#endif
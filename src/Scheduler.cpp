@@ -0,0 +1,188 @@
+#include "Arduino.h"
+#include "Scheduler.h"
+#include "FixedPoint.h"
+
+#if CAMPAIGN_ENABLED
+
+Scheduler::Scheduler(CountingGate *countingGate, const CampaignStep *campaignSteps, uint8_t stepsNumber, uint32_t pause_ms)
+{
+  gate = countingGate;
+  steps = campaignSteps;
+  stepNum = (stepsNumber > CAMPAIGN_MAX_STEPS) ? CAMPAIGN_MAX_STEPS : stepsNumber;
+  pauseMs = pause_ms;
+  savedLengthMks = 0;
+  readyMs = 0;
+  current = -1;
+  waiting = false;
+  for (uint8_t i = 0; i < CAMPAIGN_MAX_STEPS; i++) { results[i].done = false;}
+}
+
+bool Scheduler::isRunning()
+{
+  return current >= 0;
+}
+
+void Scheduler::start()
+{
+  if (isRunning() || stepNum == 0 || gate->active) { return;}
+  for (uint8_t i = 0; i < stepNum; i++)
+  {
+    results[i].counts = 0;
+    results[i].liveMks = 0;
+    results[i].endReason = GATE_END_EXTERNAL;
+    results[i].done = false;
+  }
+  savedLengthMks = gate->lengthMks;
+  current = 0;
+  waiting = true;
+  readyMs = millis();
+  Serial.print(F("Campaign started, steps = "));
+  Serial.println(stepNum);
+}
+
+void Scheduler::abort()
+{
+  if (!isRunning()) { return;}
+  current = -1;   // the stopped gate is not stored as a step result
+  waiting = false;
+  gate->stop();
+  gate->setLength(savedLengthMks);
+  Serial.println(F("Campaign aborted"));
+}
+
+// start the next step when the pause is over and the previous gate is reported (armed)
+void Scheduler::update()
+{
+  if (!waiting) { return;}
+  if ((int32_t)(millis() - readyMs) < 0) { return;}
+  if (!gate->armed || gate->active) { return;}
+  fireStep();
+}
+
+void Scheduler::fireStep()
+{
+  const CampaignStep &step = steps[current];
+  Serial.print(F("Campaign step "));
+  Serial.print(current + 1);
+  Serial.print('/');
+  Serial.print(stepNum);
+  Serial.print(F(": "));
+  Serial.print(step.role == STEP_BACKGROUND ? F("background ") : F("sample "));
+  Serial.println((const __FlashStringHelper *)step.label);
+  waiting = false;
+  gate->setLength(step.lengthMs * 1000UL);
+  gate->fire(GATE_SRC_SCHEDULER, TCNT0);
+}
+
+void Scheduler::gateFinished()
+{
+  if (!isRunning()) { return;}
+  if (gate->source != GATE_SRC_SCHEDULER)
+  {
+    // a trigger gate came first, the step was not started: start it again
+    waiting = true;
+    return;
+  }
+  if (waiting) { return;}
+  StepResult &result = results[current];
+  result.counts = gate->totalCounts();
+  result.liveMks = gate->liveMks();
+  result.endReason = gate->endReason;
+  result.done = true;
+
+  if (++current < stepNum)
+  {
+    waiting = true;
+    readyMs = millis() + pauseMs;
+    return;
+  }
+  current = -1;
+  gate->setLength(savedLengthMks);
+  Serial.println(F("Campaign finished"));
+  printResults();
+}
+
+// rate +- sigma [cps] from values in 1/1000 cps
+void Scheduler::printRate(int32_t rate, uint32_t sigma)
+{
+  printFixedSigned(Serial, rate, 3);
+  Serial.print(F(" +- "));
+  printFixed(Serial, sigma, 3);
+  Serial.print(F(" cps"));
+}
+
+// Background steps are pooled (sum of counts / sum of live time), every sample
+// step is reported as a net rate with sigma = sqrt(sigma_sample^2 + sigma_background^2).
+// C,<step>,<role>,<live [mks]>,<counts>,<rate [mcps]>,<sigma [mcps]>,<net [mcps]>,<net sigma [mcps]>
+void Scheduler::printResults()
+{
+  uint32_t bkgCounts = 0;
+  uint32_t bkgLive = 0;
+  for (uint8_t i = 0; i < stepNum; i++)
+  {
+    if (results[i].done && steps[i].role == STEP_BACKGROUND)
+    {
+      bkgCounts += results[i].counts;
+      bkgLive += results[i].liveMks;
+    }
+  }
+  uint32_t bkgRate = rateMilliCps(bkgCounts, bkgLive);
+  uint32_t bkgSigma = rateSigmaMilliCps(bkgCounts, bkgLive);
+
+  Serial.print(F("Background = "));
+  if (bkgLive > 0) { printRate(bkgRate, bkgSigma);}
+  else { Serial.print(F("not measured"));}
+  Serial.println();
+
+  for (uint8_t i = 0; i < stepNum; i++)
+  {
+    const StepResult &result = results[i];
+    Serial.print(F("Step "));
+    Serial.print(i + 1);
+    Serial.print(' ');
+    Serial.print((const __FlashStringHelper *)steps[i].label);
+    if (!result.done)
+    {
+      Serial.println(F(": not measured"));
+      continue;
+    }
+    uint32_t rate = rateMilliCps(result.counts, result.liveMks);
+    uint32_t sigma = rateSigmaMilliCps(result.counts, result.liveMks);
+    int32_t net = 0;
+    uint32_t netSigma = 0;
+    Serial.print(F(": counts = "));
+    Serial.print(result.counts);
+    Serial.print(F("  live = "));
+    printFixed(Serial, result.liveMks, 6);
+    Serial.print(F(" s  rate = "));
+    printRate(rate, sigma);
+    if (steps[i].role == STEP_SAMPLE && bkgLive > 0)
+    {
+      net = (int32_t)rate - (int32_t)bkgRate;
+      netSigma = quadratureSum(sigma, bkgSigma);
+      Serial.print(F("  net = "));
+      printRate(net, netSigma);
+    }
+    if (result.endReason == GATE_END_PRECISION) { Serial.print(F("  (precision target reached)"));}
+    Serial.println();
+
+    Serial.print(F("C,"));
+    Serial.print(i + 1);
+    Serial.print(',');
+    Serial.print(steps[i].role);
+    Serial.print(',');
+    Serial.print(result.liveMks);
+    Serial.print(',');
+    Serial.print(result.counts);
+    Serial.print(',');
+    Serial.print(rate);
+    Serial.print(',');
+    Serial.print(sigma);
+    Serial.print(',');
+    Serial.print(net);
+    Serial.print(',');
+    Serial.println(netSigma);
+  }
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef Scheduler_h
+#define Scheduler_h
+
+// Measurement campaign: a programmed sequence of background and sample gates,
+// run unattended by a single start. Results are buffered until the next start,
+// sample steps are reported as net rates (minus the pooled background rate)
+// with propagated Poisson uncertainties.
+
+// SETUP
+#define CAMPAIGN_ENABLED 0      // [0 or 1] the button starts the campaign instead of a single gate
+#define CAMPAIGN_MAX_STEPS 8    // RAM: 10 bytes per step result
+#define CAMPAIGN_PAUSE 0        // [ms] pause between steps (sample change)
+
+#include "Arduino.h"
+#include "Gate.h"
+
+#define STEP_BACKGROUND 'B'
+#define STEP_SAMPLE 'S'
+
+#define GATE_SRC_SCHEDULER 'C'
+
+struct CampaignStep
+{
+  char role;            // STEP_BACKGROUND or STEP_SAMPLE
+  uint32_t lengthMs;    // [ms] gate length (max time with a precision target)
+  const char *label;    // PROGMEM string
+};
+
+struct StepResult
+{
+  uint32_t counts;
+  uint32_t liveMks;
+  char endReason;
+  bool done;
+};
+
+class Scheduler
+{
+  public:
+    // Constructor, the steps table must stay valid (const global)
+    Scheduler(CountingGate *countingGate, const CampaignStep *campaignSteps, uint8_t stepsNumber, uint32_t pause_ms);
+
+    void start();         // run the campaign from the first step
+    void abort();         // stop the campaign (the current gate is stopped too)
+    void update();        // call from loop(): starts the next step when the gate is ready
+    void gateFinished();  // call when the gate of the current step has been reported
+    void printResults();  // print buffered results (kept until the next campaign start)
+
+    bool isRunning();
+
+    uint32_t pauseMs;     // [ms] pause between steps (sample change)
+
+  private:
+    void fireStep();
+    void printRate(int32_t rate, uint32_t sigma);
+
+    CountingGate *gate;
+    const CampaignStep *steps;
+    uint8_t stepNum;
+    StepResult results[CAMPAIGN_MAX_STEPS];
+    uint32_t savedLengthMks;  // gate length before the campaign
+    uint32_t readyMs;         // millis() when the next step may start
+    int8_t current;           // running step, -1 == no campaign
+    bool waiting;             // next step is waiting for the pause and the gate
+};
+
+#endif
@@ -10,7 +10,11 @@
 #define BUT_PIN 4         // start Button pin
 #define STATE_LED_PIN 5   // state LED indicator pin
 
-#define COUNTING_TIME 10000      // [ms] default 10000 ms == 10 s
+#define COUNTING_TIME 10000      // [ms] default 10000 ms == 10 s (max time with TARGET_UNCERTAINTY)
+#define COUNTING_TIME_1 1000     // [ms] channel 1 gate length with INDEPENDENT_GATES (see Gate.h)
+#define GATE1_REPEAT 1           // [0 or 1] channel 1 gates follow each other while the channel 0 gate counts
+#define TARGET_UNCERTAINTY 0     // [ppm] end the gate at this relative uncertainty of the total count
+                                 // (10000 == 1 % == 10^4 counts), 0 == full COUNTING_TIME
 #define N1_INTERRUPT_PIN 2
 #define N1_INTERRUPT 0      // D2 == Interrupt#0
 #define N1_ANALOG_PIN A2    // neutron output pulled up to VDD (about +4 V)
@@ -29,9 +33,8 @@ void printRegisters();  // for debug
 // void reAttachInterrupt(uint8_t interruptNum, int mode);
 
 // variables
-bool countingAllowed = false;
-unsigned long lastAllowedTime = 0;
 unsigned long lastDispTime = 0;
+unsigned long lastRossiTime = 0;
 bool DEBUG = true;
 
 // objects
@@ -42,9 +45,96 @@ SimpleLED state_indicator(STATE_LED_PIN);
 #define N_COUNTERS_NUMBER 2     // number of interrupts used [1-2]
 #define PULSE_TIME 5500         // [mks]
 #include "NeutronCounter.h"
+#include "Multiscaler.h"
+#include "ListMode.h"
+#include "Gate.h"
+#include "Scheduler.h"
+#include "FeynmanY.h"
+#include "RossiAlpha.h"
+#include "RegisterMap.h"
+#include "Checkpoint.h"
+
+void printRate(CountingGate &g);        // total count rate of the gate
+void reportGateStart(CountingGate &g);  // S record
+void reportGateEnd(CountingGate &g);    // statistics, rate, G (and W) records
+void initCounting();                    // counters and gates
+
+#if INDEPENDENT_GATES
+// channel 0 (primary gate, Timer0 Compare B) and channel 1 (Timer0 Compare A) are gated separately
+CountingGate gate(&nCounter[0], 1);
+CountingGate gate1(&nCounter[1], 1, GATE_COMPARE_A, false);
+#else
+CountingGate gate(nCounter, N_COUNTERS_NUMBER);
+#endif
+// analysis modes and the register map follow the primary gate's counters only:
+// the channel 1 gate (INDEPENDENT_GATES) flushes its counter at its own start
+#if MULTISCALER_ENABLED
+Multiscaler mcs(gate.channels(), gate.channelsNumber(), MCS_DWELL_TICKS);
+#endif
+#if REGMAP_ENABLED
+RegisterMap regMap(&gate, gate.channels(), gate.channelsNumber());
+#endif
+#if FEYNMAN_ENABLED
+const uint16_t fyWidths[] = {8, 16, 32, 64, 128, 256};   // sub-gate widths [Timer0 periods, 1024 mks], >= 7 (see FeynmanY.h)
+FeynmanY fy(gate.channels(), gate.channelsNumber(), fyWidths, sizeof(fyWidths) / sizeof(fyWidths[0]));
+#endif
+#if CAMPAIGN_ENABLED
+// measurement campaign, started by the button (or 'c' from Serial)
+const char stepBackground1[] PROGMEM = "background 1";
+const char stepSample[] PROGMEM = "sample";
+const char stepBackground2[] PROGMEM = "background 2";
+const CampaignStep campaign[] = {
+  {STEP_BACKGROUND, 10000, stepBackground1},
+  {STEP_SAMPLE,     10000, stepSample},
+  {STEP_BACKGROUND, 10000, stepBackground2},
+};
+Scheduler scheduler(&gate, campaign, sizeof(campaign) / sizeof(campaign[0]), CAMPAIGN_PAUSE);
+void serialCommand();   // 'c' == start, 'a' == abort, 'r' == print results
+#endif
+
+#ifdef __AVR__
+// SRAM budget: the Arduino core (Serial buffers, millis) takes about 200 bytes,
+// the stack needs about 256 (Serial printing in loop() + interrupt frames)
+const size_t ramUsed = sizeof(nCounter) + sizeof(gate)
+#if INDEPENDENT_GATES
+  + sizeof(gate1)
+#endif
+#if MULTISCALER_ENABLED
+  + sizeof(mcs)
+#endif
+#if REGMAP_ENABLED
+  + sizeof(regMap)
+#endif
+#if FEYNMAN_ENABLED
+  + sizeof(fy)
+#endif
+#if CAMPAIGN_ENABLED
+  + sizeof(scheduler)
+#endif
+#if LIST_MODE_ENABLED
+  + LIST_MODE_RAM
+#endif
+#if ROSSI_ENABLED
+  + sizeof(RossiState)
+#endif
+#if WARM_RESTART_ENABLED
+  + sizeof(checkpoint)
+#endif
+  ;
+static_assert(ramUsed <= RAMEND - RAMSTART + 1 - 200 - 256,
+              "SRAM: the enabled modes do not fit, lower REG_COUNT_MAX (NeutronCounter.h) or the mode buffers");
+#endif
 
 //==============================================================================
 void setup() {
+#if WARM_RESTART_ENABLED
+  // warm restart: resume the interrupted gate first, the display and Serial come after
+  bool warm = checkpointValid();
+  if (!warm) { checkpointClear();}
+  initCounting();
+  if (warm) { gate.resume(checkpoint);}
+#endif
+
   state_indicator.init();
   // debug_port.init();
 
@@ -60,45 +150,122 @@ void setup() {
   // state_indicator.init();
   // debug_port.init();
 
-  for (int i = 0; i < N_COUNTERS_NUMBER; i++) { nCounter[i].init();}
+#if !WARM_RESTART_ENABLED
+  initCounting();
+#endif
+#if REGMAP_ENABLED
+  regMap.init(REGMAP_TWI_ADDRESS);
+#endif
 
   // pinMode(10, OUTPUT);   // DEBUG
   if (DEBUG) { Serial.begin(57600);}  // DEBUG
+#if WARM_RESTART_ENABLED
+  if (warm)
+  {
+    Serial.print(F("Warm restart, gate "));
+    Serial.print(checkpoint.gate);   // a finished gate is not resumed, its number neither
+    Serial.println(gate.active ? F(" resumed") : F(" was not counting"));
+  }
+  else { delay(200);}
+#else
   delay(200);
+#endif
+  gate.arm();
+#if INDEPENDENT_GATES
+  gate1.arm();
+#endif
 
 }
 
 //==============================================================================
 void loop() {
   // check for button pressed
-  if (!countingAllowed && digitalRead(BUT_PIN) == HIGH )
+#if CAMPAIGN_ENABLED
+  serialCommand();
+  if (!gate.active && !scheduler.isRunning() && digitalRead(BUT_PIN) == HIGH )
+  {
+    scheduler.start();
+  }
+#else
+  if (!gate.active && digitalRead(BUT_PIN) == HIGH )
+  {
+    gate.fire(GATE_SRC_BUTTON, TCNT0);
+  }
+#endif
+#if INDEPENDENT_GATES
+  if (!gate1.active && digitalRead(BUT_PIN) == HIGH )
+  {
+    gate1.fire(GATE_SRC_BUTTON, TCNT0);
+  }
+#endif
+
+  if (gate.takeStarted())
   {
     disp.showNumberDec(0);
-    countingAllowed = true;
-    lastAllowedTime = millis();
-    for (int i = 0; i < N_COUNTERS_NUMBER; i++) { nCounter[i].flush();}
-    for (int i = 0; i < N_COUNTERS_NUMBER; i++) { nCounter[i].startCounting();}
-    // for (int i = 0; i < N_COUNTERS_NUMBER; i++) { nCounter[i].startCounting();}
     state_indicator.on();
+    reportGateStart(gate);
   }
+#if INDEPENDENT_GATES
+  if (gate1.takeStarted()) { reportGateStart(gate1);}
+#endif
 
-  if (countingAllowed)
+  if (gate.active)
   {
-    if (millis() - lastAllowedTime >= COUNTING_TIME)
+#if (MULTISCALER_ENABLED && MCS_STREAM)
+    mcs.printBins();
+#endif
+#if LIST_MODE_ENABLED
+    listModePrint();
+#endif
+#if (ROSSI_ENABLED && RA_STREAM)
+    if (millis() - lastRossiTime >= RA_STREAM_PERIOD)
     {
-      for (int i = 0; i < N_COUNTERS_NUMBER; i++) { nCounter[i].stopCounting();}
-      countingAllowed = false;
-      // cli();
-      state_indicator.off();
-      // disp.setSlowMode();
-      // displayResult();
-      // disp.setFastMode();
-      // sei();
-      printNeutronStats();
+      lastRossiTime = millis();
+      rossiPrint(gate.number);
     }
+#endif
   }
 
-  displayResult();
+  if (gate.takeFinished())
+  {
+    // cli();
+    state_indicator.off();
+    // disp.setSlowMode();
+    // displayResult();
+    // disp.setFastMode();
+    // sei();
+#if LIST_MODE_ENABLED
+    listModePrint();
+#endif
+    reportGateEnd(gate);
+#if MULTISCALER_ENABLED
+    mcs.printBins();
+#endif
+#if FEYNMAN_ENABLED
+    fy.printResults(gate.number);
+#endif
+#if ROSSI_ENABLED
+    rossiPrint(gate.number);
+#endif
+#if CAMPAIGN_ENABLED
+    scheduler.gateFinished();
+#endif
+  }
+
+#if REGMAP_ENABLED
+  regMap.update();   // before arm(): the last gate's counts are kept while the gate is armed
+#endif
+  gate.arm();   // results are reported, the next gate can be started by the trigger
+#if INDEPENDENT_GATES
+  if (gate1.takeFinished()) { reportGateEnd(gate1);}
+  gate1.arm();
+  if (GATE1_REPEAT && gate.active && gate1.armed) { gate1.fire(GATE_SRC_REPEAT, TCNT0);}
+#endif
+#if CAMPAIGN_ENABLED
+  scheduler.update();   // next campaign step
+#endif
+
+  if (!gate.armed) { displayResult();}   // an armed gate has flushed counters, the last result stays
 
   // if (DEBUG && nCounter[0].have_new)
   // {
@@ -133,28 +300,96 @@ void loop() {
 void displayResult()
 {
   unsigned int number = 0;
-  for (int i = 0; i < N_COUNTERS_NUMBER; i++)
+  for (int i = 0; i < gate.channelsNumber(); i++)   // the display follows the primary gate
   {
-     number += nCounter[i].GetPulseNumber();
+     number += gate.channels()[i].GetPulseNumber();
   }
   disp.showNumberDec(number);
   // Serial.println(number);  // DEBUG
 }
 
+void printRate(CountingGate &g)
+{
+  Serial.print(F("Live time = "));
+  printFixed(Serial, g.liveMks(), 6);
+  Serial.println(F(" s"));
+  Serial.print(F("Count rate = "));
+  printFixed(Serial, rateMilliCps(g.totalCounts(), g.liveMks()), 3);
+  Serial.println(F(" cps"));
+  Serial.print(F("Uncertainty = "));
+  printFixed(Serial, g.uncertaintyPpm(), 4);
+  Serial.print(F(" %"));
+  if (g.endReason == GATE_END_PRECISION) { Serial.print(F("  (precision target reached)"));}
+  Serial.println();
+  if (g.interruptions > 0)
+  {
+    Serial.print(F("Interrupted by reset "));
+    Serial.print(g.interruptions);
+    Serial.print(F(" time(s), lost time <= "));
+    printFixed(Serial, g.lostMks, 6);
+    Serial.println(F(" s"));
+  }
+  Serial.print(F("Start latency = "));   // from the trigger interrupt entry, not from the edge
+  Serial.print(g.startLatency);
+  Serial.println(g.source == GATE_SRC_TRIGGER ? F(" mks (trigger)") :
+                 g.source == GATE_SRC_SCHEDULER ? F(" mks (campaign)") :
+                 g.source == GATE_SRC_REPEAT ? F(" mks (repeated)") : F(" mks (button)"));
+}
+
+void reportGateStart(CountingGate &g)
+{
+  printGateStartRecord(g.number, g.startMks, g.source, g.startLatency, g.channels(), g.channelsNumber());
+}
+
+void reportGateEnd(CountingGate &g)
+{
+  printNeutronStats(g.channels(), g.channelsNumber());
+  printRate(g);
+  printGateRecord(g.number, g.liveMks(), g.endReason, g.uncertaintyPpm(), g.channels(), g.channelsNumber());
+  if (g.interruptions > 0) { printRestartRecord(g.number, g.interruptions, g.lostMks);}
+}
+
+// counters and gates, also the first thing of a warm restart
+void initCounting()
+{
+  for (int i = 0; i < N_COUNTERS_NUMBER; i++) { nCounter[i].init();}
+  gate.init();
+  gate.setLength(COUNTING_TIME * 1000UL);   // the gate is ended by Timer0, see CountingGate::tick()
+  gate.setTargetUncertainty(TARGET_UNCERTAINTY);
+#if INDEPENDENT_GATES
+  gate1.init();
+  gate1.setLength(COUNTING_TIME_1 * 1000UL);
+  gate1.setTargetUncertainty(TARGET_UNCERTAINTY);
+#endif
+}
+
+#if CAMPAIGN_ENABLED
+void serialCommand()
+{
+  if (!Serial.available()) { return;}
+  switch (Serial.read())
+  {
+    case 'c': if (!gate.active) { scheduler.start();} break;
+    case 'a': scheduler.abort(); break;
+    case 'r': scheduler.printResults(); break;
+  }
+}
+#endif
+
 // for debug
 void printRegisters()
 {
-  Serial.print("  TCCR1A = ");
+  Serial.print(F("  TCCR1A = "));
   Serial.print(TCCR1A);
-  Serial.print("  TCCR1B = ");
+  Serial.print(F("  TCCR1B = "));
   Serial.print(TCCR1B);
-  Serial.print("  TIMSK1 = ");
+  Serial.print(F("  TIMSK1 = "));
   Serial.println(TIMSK1);
   
-  Serial.print("  TCCR2A = ");
+  Serial.print(F("  TCCR2A = "));
   Serial.print(TCCR2A);
-  Serial.print("  TCCR2B = ");
+  Serial.print(F("  TCCR2B = "));
   Serial.print(TCCR2B);
-  Serial.print("  TIMSK2 = ");
+  Serial.print(F("  TIMSK2 = "));
   Serial.println(TIMSK2);
 }
\ No newline at end of file
@@ -0,0 +1,80 @@
+// fw_sim: minimal Arduino core for the host build of the firmware sources.
+// AVR registers are plain variables (defined in fw_sim.cpp). cli() and sei() are empty:
+// the simulation calls interrupt handlers and loop() one after another, never nested.
+// F() and PROGMEM strings stay ordinary strings.
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#define F_CPU 16000000UL
+typedef bool boolean; typedef uint8_t byte;
+
+// AVR registers (ATmega328) used by the firmware
+#define REG8(n) extern volatile uint8_t n;
+#define REG16(n) extern volatile uint16_t n;
+REG8(TCCR0A) REG8(TCCR0B) REG8(TCNT0) REG8(OCR0A) REG8(OCR0B) REG8(TIMSK0) REG8(TIFR0)
+REG8(TCCR1A) REG8(TCCR1B) REG16(TCNT1) REG16(OCR1A) REG16(OCR1B) REG8(TIMSK1) REG8(TIFR1)
+REG8(TCCR2A) REG8(TCCR2B) REG8(TCNT2) REG8(OCR2A) REG8(OCR2B) REG8(TIMSK2) REG8(TIFR2)
+REG8(EIFR) REG8(EICRA) REG8(EIMSK) REG8(SREG) REG8(MCUSR)
+REG8(ADMUX) REG8(ADCSRA) REG8(ADCSRB) REG8(ADCL) REG8(ADCH) REG16(ADC) REG8(DIDR0)
+REG8(PCICR) REG8(PCMSK0) REG8(PCMSK1) REG8(PCMSK2) REG8(PCIFR) REG8(PINB) REG8(PORTB) REG8(DDRB) REG8(PIND) REG8(PORTD) REG8(DDRD)
+REG8(TWAR) REG8(TWCR) REG8(TWDR) REG8(TWSR) REG8(GPIOR0)
+
+// register bits
+enum { CS00=0,CS01,CS02, CS10=0,CS11,CS12, CS20=0,CS21,CS22, WGM12=3, WGM21=1, WGM01=1, WGM00=0,
+ OCIE1A=1, OCIE1B=2, TOIE1=0, OCF1A=1, OCF1B=2, TOV1=0, OCIE2A=1, TOIE2=0, OCF2A=1, TOV2=0, OCIE0A=1, OCIE0B=2, TOIE0=0, OCF0B=2, OCF0A=1, TOV0=0,
+ INTF0=0, INTF1=1, ISC00=0, ISC01=1, ISC10=2, ISC11=3, INT0=0, INT1=1,
+ REFS0=6, REFS1=7, ADLAR=5, MUX0=0, ADEN=7, ADSC=6, ADATE=5, ADIF=4, ADIE=3, ADPS0=0, ADPS1=1, ADPS2=2, ADTS0=0, ADC2D=2, ADC3D=3,
+ PCIE0=0, PCIE1=1, PCIE2=2, PCINT0=0, PCIF0=0, PB0=0, PB1=1, PB2=2, PD4=4,
+ WDRF=3, BORF=2, EXTRF=1, PORF=0, TWEA=6, TWEN=2, TWIE=0, TWINT=7, TWSTO=4, TWSTA=5 };
+
+#define _BV(b) (1<<(b))
+#define ISR(v) extern "C" void v(void)
+#define ISR_NOBLOCK
+#define cli() do{}while(0)
+#define sei() do{}while(0)
+
+// Arduino core
+#define RISING 3
+#define FALLING 2
+#define CHANGE 1
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define DEFAULT 1
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) ((p)==2?0:((p)==3?1:-1))
+#define PROGMEM
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define PSTR(s) (s)
+#define DEC 10
+#define HEX 16
+
+void pinMode(uint8_t,uint8_t); void digitalWrite(uint8_t,uint8_t); int digitalRead(uint8_t);
+void attachInterrupt(uint8_t, void(*)(void), int); void detachInterrupt(uint8_t);
+unsigned long millis(); unsigned long micros(); void delay(unsigned long); void delayMicroseconds(unsigned int);
+void analogReference(uint8_t); int analogRead(uint8_t);
+
+class Print { public:
+ size_t print(const __FlashStringHelper*); size_t println(const __FlashStringHelper*);
+ size_t print(const char*); size_t print(char); size_t print(int, int=DEC); size_t print(unsigned int, int=DEC);
+ size_t print(long, int=DEC); size_t print(unsigned long, int=DEC); size_t print(double, int=2);
+ size_t print(unsigned char, int=DEC);
+ size_t println(const char*); size_t println(char); size_t println(int, int=DEC); size_t println(unsigned int, int=DEC);
+ size_t println(long, int=DEC); size_t println(unsigned long, int=DEC); size_t println(double, int=2); size_t println(unsigned char, int=DEC); size_t println();
+ size_t write(uint8_t); size_t write(const uint8_t*, size_t); };
+class HardwareSerial : public Print { public: void begin(unsigned long); int available(); int read(); int peek(); int availableForWrite(); void flush(); operator bool(){return true;} };
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,17 @@
+#!/bin/sh
+# build fw_sim from a copy of the firmware sources (<output>.src) with list mode,
+# Feynman-Y and Rossi-alpha enabled, INDEPENDENT_GATES as given, the rest of the setup
+# is the default one
+# usage:  build.sh <output> [INDEPENDENT_GATES, 0 or 1]   (make -C tools fw_sim/fw_sim)
+set -e
+HERE=$(dirname "$0")
+ROOT=$HERE/../..
+SRC=$1.src
+rm -rf "$SRC"
+cp -r "$ROOT/src" "$SRC"
+for h in ListMode.h FeynmanY.h RossiAlpha.h; do
+  sed -i 's/\(#define [A-Z_]*_ENABLED\) 0 /\1 1 /' "$SRC/$h"
+done
+sed -i "s/#define INDEPENDENT_GATES 0 /#define INDEPENDENT_GATES ${2:-0} /" "$SRC/Gate.h"
+${CXX:-g++} -std=gnu++11 -O1 -w -I"$HERE" -I"$SRC" -I"$ROOT/lib/TM1637-1.2.0" \
+  "$SRC"/*.cpp "$ROOT/lib/TM1637-1.2.0/TM1637Display.cpp" "$HERE/fw_sim.cpp" -o "$1"
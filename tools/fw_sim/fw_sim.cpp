@@ -0,0 +1,162 @@
+// fw_sim - the firmware sources on the host, with simulated timers, pins and pulses
+//
+// setup() and loop() of src/ run against the Arduino.h of this directory. Time goes in
+// 4 mks steps (one Timer0 tick):
+// - Timer0 (TCNT0, OCR0A/B double buffered at BOTTOM) calls the gate ticks,
+// - Timer1/Timer2 run from the rising front of a pulse (64 mks ticks, compare at 100),
+// - INT0/INT1 handlers are called at the pulse edges selected by attachInterrupt()
+//   while their EIMSK bit is set, TCNT1/TCNT2 hold the ticks at the falling front,
+// - the ADC conversion ends 104 mks after ADSC with a random 8 bit height,
+// - loop() runs every 1000 mks, the button (D4) is pressed at 0.4 s and at 11 s.
+// Pulses come in correlated chains (Poisson chain starts, 1 - 4 neutrons per chain,
+// 700 mks mean delay, random channel). 85 % of the widths are of one to five count
+// periods, 12 % are shorter than one period, 3 % are of five to eleven periods.
+// Overlapping pulses of one channel are dropped.
+// Serial output goes to stdout.
+//
+// build:  make -C tools fw_sim/fw_sim  (build.sh: list mode, Feynman-Y and Rossi-alpha on)
+// usage:  fw_sim [seed] [seconds] [chains per second]
+//         make -C tools capture  regenerates nc_analyze/test_capture.txt (5 22 15),
+//         the random streams are those of libstdc++ (GCC)
+#include "Arduino.h"
+#include <cstdio>
+#include <cinttypes>
+#include <vector>
+#include <algorithm>
+#include <random>
+#define D8(n) volatile uint8_t n;
+#define D16(n) volatile uint16_t n;
+D8(TCCR0A) D8(TCCR0B) D8(TCNT0) D8(OCR0A) D8(OCR0B) D8(TIMSK0) D8(TIFR0)
+D8(TCCR1A) D8(TCCR1B) D16(TCNT1) D16(OCR1A) D16(OCR1B) D8(TIMSK1) D8(TIFR1)
+D8(TCCR2A) D8(TCCR2B) D8(TCNT2) D8(OCR2A) D8(OCR2B) D8(TIMSK2) D8(TIFR2)
+D8(EIFR) D8(EICRA) D8(EIMSK) D8(SREG) D8(MCUSR)
+D8(ADMUX) D8(ADCSRA) D8(ADCSRB) D8(ADCL) D8(ADCH) D16(ADC) D8(DIDR0)
+D8(PCICR) D8(PCMSK0) D8(PCMSK1) D8(PCMSK2) D8(PCIFR) D8(PINB) D8(PORTB) D8(DDRB) D8(PIND) D8(PORTD) D8(DDRD)
+D8(TWAR) D8(TWCR) D8(TWDR) D8(TWSR) D8(GPIOR0)
+
+static uint64_t now = 0;
+static void (*handler[2])(void) = {nullptr, nullptr};
+static std::vector<std::pair<uint64_t,uint64_t>> presses;
+
+void pinMode(uint8_t,uint8_t){} void digitalWrite(uint8_t,uint8_t){}
+int digitalRead(uint8_t pin){
+  if (pin != 4) return 0;
+  for (auto &p : presses) if (now >= p.first && now < p.second) return 1;
+  return 0;
+}
+void attachInterrupt(uint8_t n, void(*f)(void), int mode){
+  handler[n] = f;
+  int sh = n ? 2 : 0;
+  EICRA = (EICRA & ~(3 << sh)) | (mode << sh);
+  EIMSK |= (1 << n);
+}
+void detachInterrupt(uint8_t n){ EIMSK &= ~(1 << n); handler[n] = nullptr;}
+unsigned long millis(){return (unsigned long)(now / 1000);} unsigned long micros(){return (unsigned long)(uint32_t)now;}
+void delay(unsigned long){} void delayMicroseconds(unsigned int){}
+void analogReference(uint8_t){} int analogRead(uint8_t){return 0;}
+size_t Print::write(uint8_t){return 0;} size_t Print::write(const uint8_t*,size_t){return 0;}
+void HardwareSerial::begin(unsigned long){} int HardwareSerial::available(){return 0;} int HardwareSerial::read(){return -1;} int HardwareSerial::peek(){return -1;} int HardwareSerial::availableForWrite(){return 63;} void HardwareSerial::flush(){}
+HardwareSerial Serial;
+size_t Print::print(const char*s){return printf("%s",s);} size_t Print::print(char c){return printf("%c",c);} size_t Print::print(int v,int){return printf("%d",v);} size_t Print::print(unsigned int v,int){return printf("%u",v);}
+size_t Print::print(long v,int){return printf("%ld",v);} size_t Print::print(unsigned long v,int){return printf("%lu",v);} size_t Print::print(double v,int d){return printf("%.*f",d,v);} size_t Print::print(unsigned char v,int){return printf("%u",v);}
+size_t Print::println(const char*s){return printf("%s\n",s);} size_t Print::println(char c){return printf("%c\n",c);} size_t Print::println(int v,int){return printf("%d\n",v);} size_t Print::println(unsigned int v,int){return printf("%u\n",v);}
+size_t Print::println(long v,int){return printf("%ld\n",v);} size_t Print::println(unsigned long v,int){return printf("%lu\n",v);} size_t Print::println(double v,int d){return printf("%.*f\n",d,v);} size_t Print::println(unsigned char v,int){return printf("%u\n",v);} size_t Print::println(){return printf("\n");}
+size_t Print::print(const __FlashStringHelper*s){return printf("%s",(const char*)s);} size_t Print::println(const __FlashStringHelper*s){return printf("%s\n",(const char*)s);}
+
+extern "C" void TIMER0_COMPB_vect(void);
+extern "C" __attribute__((weak)) void TIMER0_COMPA_vect(void);
+extern "C" void TIMER1_COMPA_vect(void);
+extern "C" void TIMER2_COMPA_vect(void);
+extern "C" void ADC_vect(void);
+void setup(); void loop();
+
+struct Pulse { uint64_t rise, fall;};
+
+int main(int argc, char **argv)
+{
+  uint64_t seed = argc > 1 ? strtoull(argv[1], 0, 10) : 1;
+  double rate = argc > 3 ? atof(argv[3]) : 6.0;
+  uint64_t endT = argc > 2 ? strtoull(argv[2], 0, 10) * 1000000ULL : 22000000ULL;
+  std::mt19937_64 rng(seed);
+  std::exponential_distribution<double> chainGap(rate / 1e6);   // chains per mks
+  std::exponential_distribution<double> delay(1.0 / 700.0);    // neutron delay in a chain [mks]
+  std::uniform_real_distribution<double> u(0, 1);
+  std::vector<Pulse> pulses[2];
+  std::vector<Pulse> raw[2];
+  for (double t = 100000; t < endT; t += chainGap(rng))
+  {
+    int k = 1 + int(u(rng) * 3.2);
+    for (int i = 0; i < k; i++)
+    {
+      int ch = u(rng) < 0.5;
+      uint64_t rise = uint64_t(t + delay(rng)) / 4 * 4;
+      double r = u(rng);
+      uint64_t w = r < 0.12 ? 200 + uint64_t(u(rng) * 6000) : r < 0.97 ? 6400 + uint64_t(u(rng) * 26000) : 33000 + uint64_t(u(rng) * 40000);
+      raw[ch].push_back({rise, rise + w / 4 * 4});
+    }
+  }
+  for (int ch = 0; ch < 2; ch++)
+  {
+    std::sort(raw[ch].begin(), raw[ch].end(), [](const Pulse &a, const Pulse &b){ return a.rise < b.rise;});
+    uint64_t busyTo = 0;
+    for (auto &p : raw[ch]) if (p.rise > busyTo + 8) { pulses[ch].push_back(p); busyTo = p.fall;}
+  }
+  presses = {{400000, 450000}, {11000000, 11050000}};
+
+  setup();
+  size_t next[2] = {0, 0};
+  bool high[2] = {false, false};
+  uint64_t tStart[2] = {0, 0};
+  uint8_t ocrB = OCR0B, ocrA = OCR0A;
+  bool adcBusy = false; uint64_t adcT = 0;
+  for (now = 0; now < endT; now += 4)
+  {
+    uint8_t t0 = (now / 4) & 0xFF;
+    TCNT0 = t0;
+    if (t0 == 0) { ocrB = OCR0B; ocrA = OCR0A;}
+    if (t0 == ocrA && (TIMSK0 & (1 << OCIE0A)) && TIMER0_COMPA_vect) { TIMER0_COMPA_vect();}
+    if (t0 == ocrB && (TIMSK0 & (1 << OCIE0B))) { TIMER0_COMPB_vect();}
+    // count timers (prescaler 1024, 64 mks), CTC at 100
+    for (int ch = 0; ch < 2; ch++)
+    {
+      bool run = ch ? (TCCR2B & 7) : (TCCR1B & 7);
+      bool ie = ch ? (TIMSK2 & (1 << OCIE2A)) : (TIMSK1 & (1 << OCIE1A));
+      if (run && ie && now > tStart[ch] && (now - tStart[ch]) % 64 == 0)
+      {
+        uint64_t ticks = (now - tStart[ch]) / 64;
+        if (ticks % 101 == 100) { if (ch) TIMER2_COMPA_vect(); else TIMER1_COMPA_vect();}
+      }
+    }
+    for (int ch = 0; ch < 2; ch++)
+    {
+      if (next[ch] >= pulses[ch].size()) continue;
+      const Pulse &p = pulses[ch][next[ch]];
+      bool edge = false, rising = false;
+      if (!high[ch] && now == p.rise) { edge = true; rising = true; high[ch] = true;}
+      else if (high[ch] && now == p.fall) { edge = true; high[ch] = false; ++next[ch];}
+      else if (!high[ch] && now > p.rise) { ++next[ch];}
+      if (!edge) continue;
+      int mode = (EICRA >> (ch ? 2 : 0)) & 3;
+      if (!(EIMSK & (1 << ch)) || !handler[ch]) continue;
+      if ((rising && mode != RISING) || (!rising && mode != FALLING)) continue;
+      if (!rising)
+      {
+        uint64_t ticks = (now - tStart[ch]) / 64;
+        if (ch) TCNT2 = ticks % 101; else TCNT1 = ticks % 101;
+      }
+      handler[ch]();
+      if (rising) { tStart[ch] = now;}
+    }
+    if (!adcBusy && (ADCSRA & (1 << ADSC))) { adcBusy = true; adcT = now;}
+    if (adcBusy && now >= adcT + 104)
+    {
+      adcBusy = false;
+      ADCSRA &= ~(1 << ADSC);
+      ADCH = 40 + uint8_t(u(rng) * 200);
+      ADC_vect();
+    }
+    if (now % 1000 == 0) { loop();}
+  }
+  loop();
+  return 0;
+}
@@ -0,0 +1,610 @@
+// nc_aggregator - host side daemon for several Neutron Counter boards
+//
+// Reads the Serial record streams (see src/ListMode.h) of many boards at once
+// (non-blocking ports + epoll, one thread), aligns the gates of all boards in
+// time and publishes combined per-gate totals and rates to a file and/or to a
+// local (unix) socket.
+//
+// Time alignment: every board's clock (micros() of the S and E records) is
+// mapped to the host clock by the minimal observed (host - board) offset of
+// the recent records, i.e. by the records with the smallest transfer latency.
+// Gates of different boards that started within the alignment window form one
+// combined gate, which is published when every member board has sent its G
+// record (or after the timeout, marked incomplete). Only the primary gates are
+// combined, channel gates (independent gating) are kept in the raw files, which
+// get every record of the board.
+//
+// Ports can be any character device, so pseudo-terminals (/dev/pts/N) can stand
+// in for the boards.
+//
+// build:  g++ -std=c++17 -O2 -Wall -o nc_aggregator nc_aggregator.cpp  (or make -C tools)
+// test:   make -C tools test  (test_pty.py, pseudo-terminals as boards)
+// usage:  nc_aggregator [-o out_file] [-u socket_path] [-r raw_dir] [-w align_ms]
+//                       [-t timeout_ms] [-b baud] PORT [PORT ...]
+//
+// Published record (one line per combined gate):
+//   P,<group>,<start [unix ms]>,<boards>,<complete>,<total counts>,<total rate [1/1000 cps]>,
+//     {<port>,<gate>,<live time [mks]>,<counts>,<rate [1/1000 cps]>} x boards
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int READ_CHUNK = 4096;
+constexpr size_t MAX_LINE = 512;           // longer lines are garbage (wrong baud etc.)
+constexpr size_t OFFSET_WINDOW = 64;       // records used for the clock offset estimation
+constexpr int64_t REOPEN_DELAY_NS = 1000000000LL;
+
+volatile sig_atomic_t stopRequested = 0;
+
+int64_t nowNs(clockid_t clock)
+{
+  timespec ts;
+  clock_gettime(clock, &ts);
+  return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// split comma separated record
+std::vector<std::string_view> splitRecord(std::string_view line)
+{
+  std::vector<std::string_view> fields;
+  size_t pos = 0;
+  while (true)
+  {
+    size_t comma = line.find(',', pos);
+    fields.push_back(line.substr(pos, comma == std::string_view::npos ? std::string_view::npos : comma - pos));
+    if (comma == std::string_view::npos) { break;}
+    pos = comma + 1;
+  }
+  return fields;
+}
+
+bool parseUint(std::string_view text, uint64_t &value)
+{
+  if (text.empty() || text.size() > 20) { return false;}
+  uint64_t v = 0;
+  for (char c : text)
+  {
+    if (c < '0' || c > '9') { return false;}
+    v = v * 10 + uint64_t(c - '0');
+  }
+  value = v;
+  return true;
+}
+
+// S and G records of a channel 1 gate (independent gating) end with first channel > 0,
+// older firmware has no such field
+bool channelGateRecord(const std::vector<std::string_view> &f, size_t firstChannelIndex)
+{
+  uint64_t first;
+  return f.size() > firstChannelIndex && parseUint(f[firstChannelIndex], first) && first > 0;
+}
+
+uint64_t rateMilliCps(uint64_t counts, uint64_t liveMks)
+{
+  return liveMks ? (counts * 1000000000ULL + liveMks / 2) / liveMks : 0;
+}
+
+speed_t baudToSpeed(long baud)
+{
+  switch (baud)
+  {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return 0;
+  }
+}
+
+struct GateResult
+{
+  uint16_t gate = 0;
+  uint64_t liveMks = 0;
+  uint64_t counts = 0;
+};
+
+struct Board
+{
+  std::string path;
+  std::string name;         // port name used in the published records
+  int fd = -1;
+  int64_t reopenAt = 0;     // [monotonic ns]
+  std::string line;
+  FILE *raw = nullptr;
+
+  // board clock unwrapping (micros() overflows every 71.6 min)
+  bool clockValid = false;
+  uint32_t lastClock = 0;
+  uint64_t clockHigh = 0;
+  std::deque<int64_t> offsets;   // host ns - board ns
+
+  bool inGate = false;
+  uint32_t gateStartMks = 0;
+  uint64_t group = 0;       // 0 == none
+  uint64_t events = 0;
+};
+
+struct Group
+{
+  int64_t startNs = 0;      // [monotonic ns] aligned gate start
+  int64_t startUnixNs = 0;
+  int64_t deadline = 0;     // [monotonic ns] 0 == no member finished yet
+  std::map<size_t, bool> members;   // board index -> finished
+  std::map<size_t, GateResult> results;
+};
+
+class Aggregator
+{
+  public:
+    Aggregator(int64_t alignNs, int64_t timeoutNs, speed_t speed, FILE *out, std::string rawDir)
+      : alignNs(alignNs), timeoutNs(timeoutNs), speed(speed), out(out), rawDir(std::move(rawDir)) {}
+
+    bool init(const std::vector<std::string> &ports, const std::string &socketPath);
+    void run();
+
+  private:
+    void openPort(size_t idx);
+    void closePort(size_t idx);
+    void readPort(size_t idx);
+    void handleLine(size_t idx, std::string_view line, int64_t hostNs);
+    int64_t boardToHost(size_t idx, uint32_t boardMks, int64_t hostNs);
+    void gateStarted(size_t idx, int64_t startNs);
+    void gateFinished(size_t idx, const GateResult &result, int64_t hostNs);
+    void leaveGroup(size_t idx);
+    void checkGroups(int64_t now);
+    void publish(uint64_t id, Group &group);
+    void acceptClients();
+
+    int64_t alignNs;
+    int64_t timeoutNs;
+    speed_t speed;
+    FILE *out;
+    std::string rawDir;
+
+    int epfd = -1;
+    int listenFd = -1;
+    std::vector<Board> boards;
+    std::vector<int> clients;
+    std::map<uint64_t, Group> groups;
+    uint64_t nextGroup = 1;
+};
+
+// epoll data: board index, or one of these tags
+constexpr uint64_t TAG_LISTEN = ~0ULL;
+constexpr uint64_t TAG_CLIENT = 1ULL << 62;
+
+bool Aggregator::init(const std::vector<std::string> &ports, const std::string &socketPath)
+{
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0) { perror("epoll_create1"); return false;}
+
+  for (const std::string &path : ports)
+  {
+    Board b;
+    b.path = path;
+    size_t slash = path.find_last_of('/');
+    b.name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    boards.push_back(b);
+  }
+  for (size_t i = 0; i < boards.size(); i++)
+  {
+    if (!rawDir.empty())
+    {
+      std::string rawPath = rawDir + "/" + boards[i].name + ".rec";
+      boards[i].raw = fopen(rawPath.c_str(), "a");
+      if (!boards[i].raw) { perror(rawPath.c_str()); return false;}
+    }
+    openPort(i);
+  }
+
+  if (!socketPath.empty())
+  {
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) { fprintf(stderr, "socket path too long\n"); return false;}
+    strcpy(addr.sun_path, socketPath.c_str());
+    unlink(socketPath.c_str());
+    if (listenFd < 0 || bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd, 16) < 0)
+    {
+      perror(socketPath.c_str());
+      return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = TAG_LISTEN;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listenFd, &ev);
+  }
+  return true;
+}
+
+void Aggregator::openPort(size_t idx)
+{
+  Board &b = boards[idx];
+  b.fd = open(b.path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (b.fd < 0)
+  {
+    b.reopenAt = nowNs(CLOCK_MONOTONIC) + REOPEN_DELAY_NS;
+    return;
+  }
+  termios tio;
+  if (tcgetattr(b.fd, &tio) == 0)
+  {
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 1;     // with O_NONBLOCK: EAGAIN when empty, 0 only on hangup
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tcsetattr(b.fd, TCSANOW, &tio);
+  }
+  epoll_event ev{};
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.u64 = idx;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, b.fd, &ev);
+  b.line.clear();
+  b.clockValid = false;
+  b.offsets.clear();
+  fprintf(stderr, "%s: opened\n", b.name.c_str());
+}
+
+void Aggregator::closePort(size_t idx)
+{
+  Board &b = boards[idx];
+  if (b.fd >= 0)
+  {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, b.fd, nullptr);
+    close(b.fd);
+    b.fd = -1;
+    fprintf(stderr, "%s: closed\n", b.name.c_str());
+  }
+  b.inGate = false;
+  leaveGroup(idx);
+  b.reopenAt = nowNs(CLOCK_MONOTONIC) + REOPEN_DELAY_NS;
+}
+
+void Aggregator::readPort(size_t idx)
+{
+  Board &b = boards[idx];
+  char chunk[READ_CHUNK];
+  while (b.fd >= 0)
+  {
+    ssize_t n = read(b.fd, chunk, sizeof(chunk));
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { return;}
+    if (n < 0 && errno == EINTR) { continue;}
+    if (n <= 0) { closePort(idx); return;}
+
+    int64_t hostNs = nowNs(CLOCK_MONOTONIC);
+    for (ssize_t i = 0; i < n; i++)
+    {
+      char c = chunk[i];
+      if (c == '\r') { continue;}
+      if (c != '\n')
+      {
+        if (b.line.size() < MAX_LINE) { b.line.push_back(c);}
+        continue;
+      }
+      if (b.line.size() < MAX_LINE) { handleLine(idx, b.line, hostNs);}
+      b.line.clear();
+    }
+  }
+}
+
+// map board micros() to the host monotonic clock
+int64_t Aggregator::boardToHost(size_t idx, uint32_t boardMks, int64_t hostNs)
+{
+  Board &b = boards[idx];
+  if (b.clockValid && boardMks < b.lastClock && b.lastClock - boardMks > 0x80000000UL)
+  {
+    b.clockHigh += 1ULL << 32;   // micros() overflow
+  }
+  b.lastClock = boardMks;
+  b.clockValid = true;
+  int64_t boardNs = int64_t(b.clockHigh + boardMks) * 1000;
+
+  b.offsets.push_back(hostNs - boardNs);
+  if (b.offsets.size() > OFFSET_WINDOW) { b.offsets.pop_front();}
+  int64_t offset = b.offsets.front();
+  for (int64_t o : b.offsets) { offset = (o < offset) ? o : offset;}
+  return boardNs + offset;
+}
+
+void Aggregator::handleLine(size_t idx, std::string_view line, int64_t hostNs)
+{
+  Board &b = boards[idx];
+  if (line.size() < 2 || line[1] != ',') { return;}   // human readable text
+  if (b.raw)   // every record, including the ones not aggregated (F, R, W, C, ...)
+  {
+    fwrite(line.data(), 1, line.size(), b.raw);
+    fputc('\n', b.raw);
+  }
+  std::vector<std::string_view> f = splitRecord(line);
+  uint64_t v[4];
+
+  switch (line[0])
+  {
+    case 'S':   // S,<gate>,<start mks>,<channels>,...
+      if (f.size() < 4 || !parseUint(f[1], v[0]) || !parseUint(f[2], v[1]) || !parseUint(f[3], v[2])) { return;}
+      if (channelGateRecord(f, 6 + 2 * v[2])) { break;}   // only primary gates are aggregated
+      b.inGate = true;
+      b.gateStartMks = uint32_t(v[1]);
+      b.events = 0;
+      gateStarted(idx, boardToHost(idx, b.gateStartMks, hostNs));
+      break;
+
+    case 'E':   // E,<channel>,<start mks from gate start>,<width>,<height>,<flag>,<count period>
+      if (f.size() < 6 || !parseUint(f[2], v[0])) { return;}
+      ++b.events;
+      if (b.inGate) { boardToHost(idx, b.gateStartMks + uint32_t(v[0]), hostNs);}
+      break;
+
+    case 'G':   // G,<gate>,<live mks>,<channels>,{<counts>,<short>,<long>}...
+    {
+      if (f.size() < 4 || !parseUint(f[1], v[0]) || !parseUint(f[2], v[1]) || !parseUint(f[3], v[2])) { return;}
+      if (f.size() < 4 + 3 * v[2]) { return;}
+      if (channelGateRecord(f, 6 + 3 * v[2])) { break;}
+      GateResult r;
+      r.gate = uint16_t(v[0]);
+      r.liveMks = v[1];
+      for (uint64_t ch = 0; ch < v[2]; ch++)
+      {
+        if (!parseUint(f[4 + 3 * ch], v[3])) { return;}
+        r.counts += v[3];
+      }
+      gateFinished(idx, r, hostNs);
+      b.inGate = false;
+      break;
+    }
+
+    case 'X':   // X,<lost events>
+      fprintf(stderr, "%s: %.*s events lost on board\n", b.name.c_str(), int(line.size() - 2), line.data() + 2);
+      break;
+
+    default:
+      break;
+  }
+}
+
+void Aggregator::gateStarted(size_t idx, int64_t startNs)
+{
+  leaveGroup(idx);
+  uint64_t id = 0;
+  for (auto &g : groups)
+  {
+    int64_t diff = startNs - g.second.startNs;
+    if (diff < 0) { diff = -diff;}
+    if (diff <= alignNs && g.second.members.count(idx) == 0) { id = g.first; break;}
+  }
+  if (id == 0)
+  {
+    id = nextGroup++;
+    Group &g = groups[id];
+    g.startNs = startNs;
+    g.startUnixNs = nowNs(CLOCK_REALTIME) - (nowNs(CLOCK_MONOTONIC) - startNs);
+  }
+  groups[id].members[idx] = false;
+  boards[idx].group = id;
+}
+
+void Aggregator::gateFinished(size_t idx, const GateResult &result, int64_t hostNs)
+{
+  Board &b = boards[idx];
+  if (b.group == 0 || groups.count(b.group) == 0)
+  {
+    // S record was missed: the gate started one live time ago
+    gateStarted(idx, hostNs - int64_t(result.liveMks) * 1000);
+  }
+  Group &g = groups[b.group];
+  g.members[idx] = true;
+  g.results[idx] = result;
+  if (g.deadline == 0) { g.deadline = hostNs + timeoutNs;}
+  b.group = 0;
+}
+
+// board left the current gate unfinished (disconnected or restarted)
+void Aggregator::leaveGroup(size_t idx)
+{
+  Board &b = boards[idx];
+  if (b.group == 0) { return;}
+  auto it = groups.find(b.group);
+  if (it != groups.end() && !it->second.members[idx])
+  {
+    it->second.members.erase(idx);
+    if (it->second.deadline == 0) { it->second.deadline = nowNs(CLOCK_MONOTONIC) + timeoutNs;}
+  }
+  b.group = 0;
+}
+
+void Aggregator::checkGroups(int64_t now)
+{
+  for (auto it = groups.begin(); it != groups.end();)
+  {
+    Group &g = it->second;
+    bool complete = !g.members.empty();
+    for (auto &m : g.members) { complete = complete && m.second;}
+    if (complete || (g.deadline != 0 && now >= g.deadline))
+    {
+      publish(it->first, g);
+      for (auto &m : g.members)
+      {
+        if (boards[m.first].group == it->first) { boards[m.first].group = 0;}
+      }
+      it = groups.erase(it);
+    }
+    else { ++it;}
+  }
+}
+
+void Aggregator::publish(uint64_t id, Group &group)
+{
+  bool complete = !group.members.empty();
+  for (auto &m : group.members) { complete = complete && m.second;}
+
+  uint64_t totalCounts = 0;
+  uint64_t totalRate = 0;
+  std::string perBoard;
+  for (auto &r : group.results)
+  {
+    uint64_t rate = rateMilliCps(r.second.counts, r.second.liveMks);
+    totalCounts += r.second.counts;
+    totalRate += rate;
+    char buf[160];
+    snprintf(buf, sizeof(buf), ",%s,%u,%llu,%llu,%llu", boards[r.first].name.c_str(), unsigned(r.second.gate),
+             (unsigned long long)r.second.liveMks, (unsigned long long)r.second.counts, (unsigned long long)rate);
+    perBoard += buf;
+  }
+  if (group.results.empty()) { return;}
+
+  char head[160];
+  snprintf(head, sizeof(head), "P,%llu,%lld,%zu,%d,%llu,%llu", (unsigned long long)id,
+           (long long)(group.startUnixNs / 1000000), group.results.size(), complete ? 1 : 0,
+           (unsigned long long)totalCounts, (unsigned long long)totalRate);
+  std::string record = head + perBoard + "\n";
+
+  if (out)
+  {
+    fputs(record.c_str(), out);
+    fflush(out);
+  }
+  for (size_t i = 0; i < clients.size();)
+  {
+    ssize_t n = send(clients[i], record.data(), record.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n != ssize_t(record.size()))
+    {
+      // slow or gone client: drop it rather than block the ports
+      epoll_ctl(epfd, EPOLL_CTL_DEL, clients[i], nullptr);
+      close(clients[i]);
+      clients.erase(clients.begin() + i);
+    }
+    else { ++i;}
+  }
+}
+
+void Aggregator::acceptClients()
+{
+  while (true)
+  {
+    int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) { return;}
+    epoll_event ev{};
+    ev.events = EPOLLRDHUP;
+    ev.data.u64 = TAG_CLIENT | uint64_t(fd);
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    clients.push_back(fd);
+  }
+}
+
+void Aggregator::run()
+{
+  std::vector<epoll_event> events(64 + boards.size());
+  while (!stopRequested)
+  {
+    int n = epoll_wait(epfd, events.data(), int(events.size()), 100);
+    if (n < 0 && errno != EINTR) { perror("epoll_wait"); return;}
+    for (int i = 0; i < n; i++)
+    {
+      uint64_t tag = events[i].data.u64;
+      if (tag == TAG_LISTEN) { acceptClients(); continue;}
+      if (tag & TAG_CLIENT)
+      {
+        int fd = int(tag & ~TAG_CLIENT);
+        for (size_t c = 0; c < clients.size(); c++)
+        {
+          if (clients[c] != fd) { continue;}
+          epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+          close(fd);
+          clients.erase(clients.begin() + c);
+          break;
+        }
+        continue;
+      }
+      if (events[i].events & EPOLLIN) { readPort(size_t(tag));}
+      if (boards[tag].fd >= 0 && (events[i].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP))) { closePort(size_t(tag));}
+    }
+
+    int64_t now = nowNs(CLOCK_MONOTONIC);
+    for (size_t i = 0; i < boards.size(); i++)
+    {
+      if (boards[i].fd < 0 && now >= boards[i].reopenAt) { openPort(i);}
+    }
+    checkGroups(now);
+    for (Board &b : boards)
+    {
+      if (b.raw) { fflush(b.raw);}
+    }
+  }
+  checkGroups(INT64_MAX);
+}
+
+void onSignal(int) { stopRequested = 1;}
+
+void usage()
+{
+  fprintf(stderr, "usage: nc_aggregator [-o out_file] [-u socket_path] [-r raw_dir] [-w align_ms] "
+                  "[-t timeout_ms] [-b baud] PORT [PORT ...]\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  std::string outPath;
+  std::string socketPath;
+  std::string rawDir;
+  long alignMs = 500;
+  long timeoutMs = 5000;
+  long baud = 57600;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "o:u:r:w:t:b:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 'o': outPath = optarg; break;
+      case 'u': socketPath = optarg; break;
+      case 'r': rawDir = optarg; break;
+      case 'w': alignMs = strtol(optarg, nullptr, 10); break;
+      case 't': timeoutMs = strtol(optarg, nullptr, 10); break;
+      case 'b': baud = strtol(optarg, nullptr, 10); break;
+      default: usage(); return 2;
+    }
+  }
+  speed_t speed = baudToSpeed(baud);
+  if (optind >= argc || speed == 0) { usage(); return 2;}
+
+  FILE *out = stdout;
+  if (!outPath.empty() && !(out = fopen(outPath.c_str(), "a"))) { perror(outPath.c_str()); return 1;}
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  Aggregator aggregator(alignMs * 1000000LL, timeoutMs * 1000000LL, speed, out, rawDir);
+  if (!aggregator.init(std::vector<std::string>(argv + optind, argv + argc), socketPath)) { return 1;}
+  aggregator.run();
+  if (!socketPath.empty()) { unlink(socketPath.c_str());}
+  return 0;
+}
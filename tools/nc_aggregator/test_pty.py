@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# nc_aggregator test: pseudo-terminals stand in for two boards, canned
+# records are written to them and the published P records are checked.
+#
+# usage:  test_pty.py [path to nc_aggregator]   (make -C tools test)
+
+import os
+import pty
+import subprocess
+import sys
+import tempfile
+import time
+
+AGGREGATOR = sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(__file__), 'nc_aggregator')
+TIMEOUT_MS = 400
+
+
+def board():
+    master, slave = pty.openpty()
+    return master, os.ttyname(slave), slave
+
+
+def send(master, *lines):
+    os.write(master, ''.join(line + '\r\n' for line in lines).encode())
+
+
+def wait_for(path, records, seconds=3.0):
+    deadline = time.monotonic() + seconds
+    while time.monotonic() < deadline:
+        with open(path) as f:
+            lines = [line.strip() for line in f if line.startswith('P,')]
+        if len(lines) >= records:
+            return lines
+        time.sleep(0.05)
+    return lines
+
+
+def check(name, condition):
+    print(('ok    ' if condition else 'FAIL  ') + name)
+    return condition
+
+
+def main():
+    a, a_name, a_slave = board()
+    b, b_name, b_slave = board()
+    with tempfile.TemporaryDirectory() as tmp:
+        out = os.path.join(tmp, 'published.txt')
+        open(out, 'w').close()
+        proc = subprocess.Popen([AGGREGATOR, '-o', out, '-r', tmp, '-t', str(TIMEOUT_MS), a_name, b_name],
+                                stderr=subprocess.PIPE, text=True)
+        opened = 0
+        while opened < 2:
+            line = proc.stderr.readline()
+            if not line:
+                print('FAIL  nc_aggregator did not open the ports')
+                return 1
+            opened += line.endswith('opened\n')
+
+        ok = True
+        # gate 1 on both boards (board clocks differ), text lines are ignored
+        send(a, 'Live time = 10.000000 s', 'S,1,1000000,2,16384,101,16384,101,B,12,0',
+             'E,0,1500,150,0,A,2')
+        send(b, 'S,7,55000000,1,16384,101,T,8,0')
+        # channel 1 gate (independent gating) on board a: not aggregated
+        send(a, 'S,1,1000100,1,16384,101,R,4,1', 'G,1,1000000,1,40,0,0,T,158113,1')
+        send(a, 'G,1,10000000,2,500,1,0,700,0,2,T,28867,0', 'F,1,8192,1220,1200,3100', 'W,1,1,2048')
+        send(b, 'G,7,5000000,1,300,0,0,T,57735,0')
+        lines = wait_for(out, 1)
+        p = lines[0].split(',') if lines else []
+        ok &= check('two boards form one complete gate', len(lines) == 1 and p[3:5] == ['2', '1'])
+        ok &= check('total counts', p[5:6] == ['1500'])
+        ok &= check('total rate', p[6:7] == ['180000'])   # 1200 / 10 s + 300 / 5 s
+        ok &= check('per board results', p[7:] == [a_name.split('/')[-1], '1', '10000000', '1200', '120000',
+                                                   b_name.split('/')[-1], '7', '5000000', '300', '60000'])
+
+        # gate 2: board b never ends it, published incomplete after the timeout
+        send(a, 'S,2,12000000,2,16384,101,16384,101,B,12,0')
+        send(b, 'S,8,66000000,1,16384,101,T,8,0')
+        send(a, 'G,2,2000000,2,10,0,0,10,0,0,T,223607,0')
+        lines = wait_for(out, 2)
+        p = lines[1].split(',') if len(lines) > 1 else []
+        ok &= check('unfinished board times out', p[3:7] == ['1', '0', '20', '10000'])
+
+        proc.terminate()
+        proc.wait(timeout=5)
+        ok &= check('no channel gate published', len(wait_for(out, 3, 0.2)) == 2)
+        with open(os.path.join(tmp, a_name.split('/')[-1] + '.rec')) as f:
+            raw = [line.strip() for line in f]
+        ok &= check('raw file keeps every record', len(raw) == 9 and raw[0].startswith('S,1,') and
+                    raw[5:7] == ['F,1,8192,1220,1200,3100', 'W,1,1,2048'])
+    for fd in (a, b, a_slave, b_slave):
+        os.close(fd)
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,950 @@
+// nc_analyze - offline analysis of recorded Neutron Counter record streams
+//
+// Reads record files (Serial captures or the raw_dir/<port>.rec files of
+// nc_aggregator, see src/ListMode.h) through mmap and reports per gate and
+// channel: rates, width histograms, busy time, cross-channel coincidences and
+// Feynman-Y noise statistics.
+// The busy time is not turned into a dead-time correction: a pulse is counted
+// by its width in compare periods (src/PulseLogic.h), not as one event, so the
+// live / (live - busy) model of lost events does not apply.
+//
+// Work split: the file is parsed by all threads in byte blocks (cut at line
+// ends), the blocks are stitched into gates in file order, then every gate is
+// cut into time blocks (a multiple of the longest Feynman-Y width, so no
+// sub-gate is split) analysed in parallel. Partial results are merged in
+// block order, so the output does not depend on the thread count.
+// Only the primary gates are analysed: list mode event times are relative
+// to them, the records of channel gates (independent gating) are skipped.
+//
+// Feynman-Y sub-gates are made of the primary gate's Timer0 periods, as in the
+// firmware: an accepted pulse adds its counts in the period of its falling
+// front (E record count period), sub-gates are numbered by feynmanSubGate().
+//
+// Firmware check: pulses are discriminated, counted and analysed with the
+// firmware's own code (src/PulseLogic.h, src/FeynmanY.h, src/RossiAlpha.h).
+// For every complete gate without lost events or resets the recomputed counts
+// and rejections must equal the G record, the recomputed verdicts the E record
+// flags, the sub-gate sums and Y the F records and the replayed Rossi-alpha
+// histograms the R records; any difference is reported and the exit status is 3.
+//
+// build:  g++ -std=c++17 -O2 -Wall -pthread -I../../src -o nc_analyze nc_analyze.cpp  (or make -C tools)
+// test:   make -C tools test  (test_capture.py, a firmware capture and altered copies of it)
+// usage:  nc_analyze [-j threads] [-m width_min] [-M width_max] [-l lld] [-c coinc_mks]
+//                    [-H hist_bin_ticks] [-n hist_bins] [-f fy_mks[,fy_mks...]] [-B block_ms] FILE [FILE ...]
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "PulseLogic.h"
+#include "FeynmanY.h"
+#include "RossiAlpha.h"
+
+namespace {
+
+constexpr size_t MAX_CHANNELS = 8;
+constexpr size_t MIN_PARSE_BLOCK = 1 << 20;   // [bytes] smaller files are not split further
+constexpr uint64_t T0_PERIOD_MKS = 1024;      // Timer0 period, gate tick (T0_MKS_PER_PERIOD of src/FixedPoint.h)
+constexpr uint64_t NO_PERIOD = UINT64_MAX;    // E record without the count period (older firmware)
+
+struct Options
+{
+  unsigned threads = 0;             // 0 == hardware concurrency
+  uint32_t widthMin = N_WIDTH_MIN;  // [ticks]
+  uint32_t widthMax = N_WIDTH_MAX;  // [ticks]
+  uint8_t lld = PH_LLD;
+  uint64_t coincMks = 100;          // coincidence window +- [mks]
+  uint32_t histBin = 8;             // [ticks]
+  uint32_t histBins = 64;           // the last bin collects longer pulses
+  std::vector<uint64_t> fyWidths {8192, 16384, 32768, 65536, 131072, 262144};  // [mks], Timer0 periods
+  uint64_t blockMks = 1000000;
+};
+
+struct Event
+{
+  uint64_t start;   // [mks] from gate start
+  uint64_t period;  // primary gate Timer0 periods before the falling front (counts added)
+  uint32_t width;   // [ticks]
+  uint8_t height;
+  char flag;
+};
+
+// accepted event of any channel, in record (== firmware handler) order
+struct Pulse
+{
+  uint64_t start;   // [mks] from gate start
+  uint8_t channel;
+};
+
+// record stream of one parse block
+enum MarkKind { MARK_START, MARK_END, MARK_LOST, MARK_FEYNMAN, MARK_ROSSI, MARK_RESTART};
+
+struct Mark
+{
+  MarkKind kind;
+  size_t eventIndex;   // events of the block before this mark
+  uint64_t line;       // line number in the block
+  uint64_t gate = 0;
+  uint64_t mks = 0;    // S: start [mks since boot], G: live time [mks], X: lost events,
+                       // F: sub-gate width [mks], R: bin width [mks], W: resets
+  uint32_t channels = 0;
+  uint32_t q8[MAX_CHANNELS] {};        // S: tick [1/256 mks]
+  uint32_t period[MAX_CHANNELS] {};    // S: ticks per count
+  uint64_t counts[MAX_CHANNELS] {};    // G, F: sub-gates and counts, R: events and truncated events
+  uint64_t rejShort[MAX_CHANNELS] {};  // G
+  uint64_t rejLong[MAX_CHANNELS] {};   // G
+  char reason = 0;                     // S: source, G: end reason, R: pairs (S or C)
+  uint64_t firstChannel = 0;           // S, G: > 0 == channel gate
+  int64_t value = 0;                   // F: Feynman-Y [ppm]
+  std::vector<uint64_t> bins;          // R: pairs per bin
+};
+
+struct ParseBlock
+{
+  const char *begin;
+  const char *end;
+  std::vector<Event> events;
+  std::vector<uint8_t> eventChannel;
+  std::vector<Mark> marks;
+  uint64_t lines = 0;
+  uint64_t badLines = 0;
+};
+
+struct Gate
+{
+  std::string file;
+  uint64_t line = 0;          // line of the S record
+  uint64_t number = 0;
+  uint64_t startMks = 0;
+  char source = '?';
+  uint32_t channels = 0;
+  uint32_t q8[MAX_CHANNELS] {};
+  uint32_t period[MAX_CHANNELS] {};
+  bool ended = false;         // G record seen
+  const Mark *end = nullptr;
+  uint64_t lost = 0;
+  uint64_t resets = 0;        // W record (warm restart): events before the reset are lost
+  bool periods = true;        // every E record has its count period
+  std::vector<Event> events[MAX_CHANNELS];   // in start (and period) order, same channel pulses never overlap
+  std::vector<Pulse> accepted;               // all channels, Rossi-alpha replay
+  std::vector<const Mark *> feynman;         // F records
+  std::vector<const Mark *> rossi;           // R records (streamed increments or one dump)
+  std::vector<uint64_t> fySubGates;          // per Options::fyWidths
+
+  uint64_t liveMks() const
+  {
+    if (end) { return end->mks;}
+    uint64_t last = 0;
+    for (uint32_t ch = 0; ch < channels; ch++)
+    {
+      if (!events[ch].empty()) { last = std::max(last, events[ch].back().start);}
+    }
+    return last;
+  }
+};
+
+// results of one time block (or of a whole gate after the merge)
+struct ChannelStats
+{
+  uint64_t events = 0;
+  uint64_t flags[4] {};         // recorded flags A, S, L, H
+  uint64_t verdicts[4] {};      // recomputed verdicts A, S, L, H
+  uint64_t flagMismatch = 0;
+  uint64_t counts = 0;          // sum of pulseCounts() of accepted pulses
+  uint64_t busyQ8 = 0;          // [1/256 mks] sum of all pulse widths
+  std::vector<uint64_t> hist;   // widths of all pulses
+};
+
+struct FeynmanStats
+{
+  uint64_t n = 0;
+  uint64_t s1 = 0;
+  unsigned __int128 s2 = 0;
+};
+
+// F record recomputed the firmware way (16 bit sub-gate counts, 32 bit sum)
+struct FeynmanCheck
+{
+  bool valid = false;   // the record's width is a whole number of Timer0 periods
+  uint32_t counts = 0;
+  int32_t yPpm = 0;
+};
+
+// firmware F and R records recomputed from the list mode events of one gate
+struct GateCheck
+{
+  std::vector<FeynmanCheck> feynman;   // per F record
+  RossiState rossi;                    // replay of the accepted events
+};
+
+struct BlockStats
+{
+  ChannelStats ch[MAX_CHANNELS];
+  uint64_t coincidences = 0;    // accepted channel 0 / channel 1 pairs inside +- coincMks
+  std::vector<FeynmanStats> fy;
+
+  void merge(const BlockStats &other, uint32_t channels)
+  {
+    for (uint32_t c = 0; c < channels; c++)
+    {
+      ChannelStats &a = ch[c];
+      const ChannelStats &b = other.ch[c];
+      a.events += b.events;
+      for (int i = 0; i < 4; i++) { a.flags[i] += b.flags[i]; a.verdicts[i] += b.verdicts[i];}
+      a.flagMismatch += b.flagMismatch;
+      a.counts += b.counts;
+      a.busyQ8 += b.busyQ8;
+      if (a.hist.size() < b.hist.size()) { a.hist.resize(b.hist.size());}
+      for (size_t i = 0; i < b.hist.size(); i++) { a.hist[i] += b.hist[i];}
+    }
+    coincidences += other.coincidences;
+    if (fy.size() < other.fy.size()) { fy.resize(other.fy.size());}
+    for (size_t w = 0; w < other.fy.size(); w++)
+    {
+      fy[w].n += other.fy[w].n;
+      fy[w].s1 += other.fy[w].s1;
+      fy[w].s2 += other.fy[w].s2;
+    }
+  }
+};
+
+int flagIndex(char flag)
+{
+  switch (flag)
+  {
+    case LM_ACCEPTED: return 0;
+    case LM_SHORT: return 1;
+    case LM_LONG: return 2;
+    case LM_HEIGHT: return 3;
+    default: return -1;
+  }
+}
+
+// rateMilliCps() of src/FixedPoint.h (that header needs Arduino.h): live time above
+// 2^22 mks is scaled to 22 bits the same way, so the rate matches the firmware's
+uint32_t rateMilliCps(uint32_t counts, uint32_t liveMks)
+{
+  if (liveMks == 0) { return 0;}
+  uint8_t shift = 0;
+  while (liveMks >= (1UL << 22)) { liveMks >>= 1; ++shift;}
+  uint32_t rate = counts / liveMks;
+  uint32_t rem = counts % liveMks;
+  for (int i = 0; i < 3; i++)
+  {
+    rem *= 1000;
+    rate = rate * 1000 + rem / liveMks;
+    rem %= liveMks;
+  }
+  if (shift == 0) { return rate + ((rem << 1) >= liveMks);}
+  return (rate + (1UL << (shift - 1))) >> shift;
+}
+
+//==============================================================================
+// parsing
+
+class FieldReader
+{
+  public:
+    FieldReader(const char *begin, const char *end) : p(begin), e(end) {}
+
+    bool number(uint64_t &value)
+    {
+      if (p >= e || *p < '0' || *p > '9') { return false;}
+      uint64_t v = 0;
+      int digits = 0;
+      while (p < e && *p >= '0' && *p <= '9')
+      {
+        v = v * 10 + uint64_t(*p++ - '0');
+        if (++digits > 19) { return false;}
+      }
+      value = v;
+      return next();
+    }
+
+    bool signedNumber(int64_t &value)
+    {
+      bool negative = (p < e && *p == '-');
+      if (negative) { ++p;}
+      uint64_t v;
+      if (!number(v) || v > uint64_t(INT64_MAX)) { return false;}
+      value = negative ? -int64_t(v) : int64_t(v);
+      return true;
+    }
+
+    bool character(char &c)
+    {
+      if (p >= e) { return false;}
+      c = *p++;
+      return next();
+    }
+
+  private:
+    // field separator or the line end
+    bool next()
+    {
+      if (p == e) { return true;}
+      if (*p == ',') { ++p; return true;}
+      return false;
+    }
+
+    const char *p;
+    const char *e;
+};
+
+bool parseLine(const char *begin, const char *end, ParseBlock &block)
+{
+  FieldReader f(begin + 2, end);
+  uint64_t v[4];
+  Mark mark;
+  mark.eventIndex = block.events.size();
+  mark.line = block.lines;
+
+  switch (begin[0])
+  {
+    case 'E':   // E,<channel>,<start>,<width>,<height>,<flag>,<count period>
+    {
+      char flag;
+      uint64_t period = NO_PERIOD;
+      if (!f.number(v[0]) || !f.number(v[1]) || !f.number(v[2]) || !f.number(v[3]) || !f.character(flag)) { return false;}
+      if (v[0] >= MAX_CHANNELS || v[2] > UINT32_MAX || v[3] > 255) { return false;}
+      if (f.number(period) && period > 0xFFFF) { return false;}   // count period mod 2^16 (newer firmware)
+      block.events.push_back(Event {v[1], period, uint32_t(v[2]), uint8_t(v[3]), flag});
+      block.eventChannel.push_back(uint8_t(v[0]));
+      return true;
+    }
+    case 'S':   // S,<gate>,<start>,<channels>,{<q8>,<period>}...,<source>,<latency>
+    {
+      mark.kind = MARK_START;
+      if (!f.number(mark.gate) || !f.number(mark.mks) || !f.number(v[0]) || v[0] > MAX_CHANNELS) { return false;}
+      mark.channels = uint32_t(v[0]);
+      for (uint32_t ch = 0; ch < mark.channels; ch++)
+      {
+        if (!f.number(v[1]) || !f.number(v[2]) || v[1] == 0 || v[2] == 0 || v[2] > 65535) { return false;}
+        mark.q8[ch] = uint32_t(v[1]);
+        mark.period[ch] = uint32_t(v[2]);
+      }
+      if (!f.character(mark.reason)) { return false;}
+      if (f.number(v[1])) { f.number(mark.firstChannel);}   // latency, first channel (newer firmware)
+      break;
+    }
+    case 'G':   // G,<gate>,<live>,<channels>,{<counts>,<short>,<long>}...,<end>,<ppm>
+    {
+      mark.kind = MARK_END;
+      if (!f.number(mark.gate) || !f.number(mark.mks) || !f.number(v[0]) || v[0] > MAX_CHANNELS) { return false;}
+      mark.channels = uint32_t(v[0]);
+      for (uint32_t ch = 0; ch < mark.channels; ch++)
+      {
+        if (!f.number(mark.counts[ch]) || !f.number(mark.rejShort[ch]) || !f.number(mark.rejLong[ch])) { return false;}
+      }
+      if (!f.character(mark.reason)) { return false;}
+      if (f.number(v[1])) { f.number(mark.firstChannel);}   // uncertainty, first channel (newer firmware)
+      break;
+    }
+    case 'X':   // X,<lost events>
+      mark.kind = MARK_LOST;
+      if (!f.number(mark.mks)) { return false;}
+      break;
+    case 'F':   // F,<gate>,<width>,<sub-gates>,<counts>,<Y [ppm]>
+      mark.kind = MARK_FEYNMAN;
+      if (!f.number(mark.gate) || !f.number(mark.mks) || !f.number(mark.counts[0]) || !f.number(mark.counts[1]) ||
+          !f.signedNumber(mark.value)) { return false;}
+      break;
+    case 'R':   // R,<gate>,<S|C>,<bin width>,<events>,<truncated>,<bins>,{<pairs>}...
+      mark.kind = MARK_ROSSI;
+      if (!f.number(mark.gate) || !f.character(mark.reason) || !f.number(mark.mks) || !f.number(mark.counts[0]) ||
+          !f.number(mark.counts[1]) || !f.number(v[0]) || v[0] > 4096) { return false;}
+      if (mark.reason != 'S' && mark.reason != 'C') { return false;}
+      mark.bins.resize(v[0]);
+      for (uint64_t &bin : mark.bins)
+      {
+        if (!f.number(bin)) { return false;}
+      }
+      break;
+    case 'W':   // W,<gate>,<resets>,<lost time>
+      mark.kind = MARK_RESTART;
+      if (!f.number(mark.gate) || !f.number(mark.mks)) { return false;}
+      break;
+    default:
+      return true;   // other records (C, ...) are not used here
+  }
+  block.marks.push_back(mark);
+  return true;
+}
+
+void parseBlock(ParseBlock &block)
+{
+  const char *p = block.begin;
+  while (p < block.end)
+  {
+    const char *nl = static_cast<const char *>(memchr(p, '\n', size_t(block.end - p)));
+    const char *lineEnd = nl ? nl : block.end;
+    const char *e = lineEnd;
+    if (e > p && e[-1] == '\r') { --e;}
+    ++block.lines;
+    // records are "<letter>,...", everything else is human readable text
+    if (e - p >= 2 && p[1] == ',' && !parseLine(p, e, block)) { ++block.badLines;}
+    p = lineEnd + 1;
+  }
+}
+
+// cut [begin, end) into about n blocks at line ends
+std::vector<ParseBlock> splitBlocks(const char *begin, const char *end, unsigned n)
+{
+  std::vector<ParseBlock> blocks;
+  size_t size = size_t(end - begin);
+  size_t step = std::max(MIN_PARSE_BLOCK, size / n + 1);
+  const char *p = begin;
+  while (p < end)
+  {
+    const char *q = (size_t(end - p) > step) ? p + step : end;
+    if (q < end)
+    {
+      const char *nl = static_cast<const char *>(memchr(q, '\n', size_t(end - q)));
+      q = nl ? nl + 1 : end;
+    }
+    ParseBlock block;
+    block.begin = p;
+    block.end = q;
+    blocks.push_back(std::move(block));
+    p = q;
+  }
+  return blocks;
+}
+
+template <typename Job>
+void runParallel(size_t jobs, unsigned threads, Job job)
+{
+  std::atomic<size_t> next {0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < jobs; i = next++) { job(i);}
+  };
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < std::min<size_t>(threads, jobs); t++) { pool.emplace_back(worker);}
+  worker();
+  for (std::thread &t : pool) { t.join();}
+}
+
+// E records hold the count period mod 2^16: the one nearest to the estimate
+// from the pulse end is taken (the gate tick phase is within one period)
+uint64_t unwrapPeriod(uint64_t recorded, uint64_t estimate)
+{
+  uint64_t p = (estimate & ~uint64_t(0xFFFF)) | recorded;
+  if (p > estimate + 0x8000 && p >= 0x10000) { p -= 0x10000;}
+  else if (p + 0x8000 < estimate) { p += 0x10000;}
+  return p;
+}
+
+// stitch parse blocks (in file order) into gates, the marks stay owned by the blocks
+void buildGates(const std::string &file, std::vector<ParseBlock> &blocks, const Options &opt,
+                std::vector<Gate> &gates, uint64_t &outside)
+{
+  Gate *gate = nullptr;
+  size_t lastEnded = SIZE_MAX;   // F, R and W records follow the G record of their gate
+  uint64_t lineBase = 0;
+  for (ParseBlock &block : blocks)
+  {
+    size_t ev = 0;
+    auto addEvents = [&](size_t upTo) {
+      for (; ev < upTo; ev++)
+      {
+        uint8_t ch = block.eventChannel[ev];
+        Event e = block.events[ev];
+        if (!gate) { ++outside; continue;}
+        if (pulseVerdict(e.width, e.height, opt.widthMin, opt.widthMax, opt.lld) == LM_ACCEPTED)
+        {
+          gate->accepted.push_back(Pulse {e.start, ch});   // Rossi-alpha pairs every channel
+        }
+        if (ch >= gate->channels) { ++outside; continue;}
+        uint64_t estimate = (e.start * 256 + uint64_t(e.width) * gate->q8[ch]) / (256 * T0_PERIOD_MKS);
+        if (e.period == NO_PERIOD)
+        {
+          gate->periods = false;
+          e.period = estimate;
+        }
+        else { e.period = unwrapPeriod(e.period, estimate);}
+        gate->events[ch].push_back(e);
+      }
+    };
+    for (const Mark &mark : block.marks)
+    {
+      addEvents(mark.eventIndex);
+      if (mark.firstChannel > 0)   // channel gate
+      {
+        if (mark.kind == MARK_END) { lastEnded = SIZE_MAX;}
+        continue;
+      }
+      if (mark.kind == MARK_FEYNMAN || mark.kind == MARK_ROSSI || mark.kind == MARK_RESTART)
+      {
+        Gate *owner = gate ? gate : (lastEnded < gates.size() ? &gates[lastEnded] : nullptr);
+        if (!owner || owner->number != mark.gate) { ++outside; continue;}
+        if (mark.kind == MARK_FEYNMAN) { owner->feynman.push_back(&mark);}
+        else if (mark.kind == MARK_ROSSI) { owner->rossi.push_back(&mark);}
+        else { owner->resets += mark.mks;}
+        continue;
+      }
+      if (mark.kind == MARK_START)
+      {
+        lastEnded = SIZE_MAX;
+        gates.emplace_back();
+        gate = &gates.back();   // previous gates may move, only the last one is used
+        gate->file = file;
+        gate->line = lineBase + mark.line + 1;
+        gate->number = mark.gate;
+        gate->startMks = mark.mks;
+        gate->source = mark.reason;
+        gate->channels = mark.channels;
+        std::copy(mark.q8, mark.q8 + MAX_CHANNELS, gate->q8);
+        std::copy(mark.period, mark.period + MAX_CHANNELS, gate->period);
+      }
+      else if (mark.kind == MARK_LOST)
+      {
+        if (gate) { gate->lost += mark.mks;}
+      }
+      else if (gate && mark.gate == gate->number && mark.channels == gate->channels)
+      {
+        gate->ended = true;
+        gate->end = &mark;
+        lastEnded = gates.size() - 1;
+        gate = nullptr;   // records up to the next S record are outside any gate
+      }
+      else
+      {
+        ++outside;   // G record without its S record
+      }
+    }
+    addEvents(block.events.size());
+    lineBase += block.lines;
+    // events are kept per gate now
+    block.events = std::vector<Event>();
+    block.eventChannel = std::vector<uint8_t>();
+  }
+}
+
+//==============================================================================
+// analysis
+
+void analyseBlock(const Gate &gate, uint64_t from, uint64_t to, const Options &opt, BlockStats &stats)
+{
+  for (uint32_t c = 0; c < gate.channels; c++)
+  {
+    const std::vector<Event> &events = gate.events[c];
+    ChannelStats &s = stats.ch[c];
+    s.hist.assign(opt.histBins, 0);
+    auto first = std::lower_bound(events.begin(), events.end(), from,
+                                  [](const Event &e, uint64_t t) { return e.start < t;});
+    for (auto it = first; it != events.end() && it->start < to; ++it)
+    {
+      ++s.events;
+      int flag = flagIndex(it->flag);
+      char verdict = pulseVerdict(it->width, it->height, opt.widthMin, opt.widthMax, opt.lld);
+      if (flag >= 0) { ++s.flags[flag];}
+      ++s.verdicts[flagIndex(verdict)];
+      if (verdict != it->flag) { ++s.flagMismatch;}
+      s.counts += pulseCounts(verdict, pulsePeriods(it->width, uint16_t(gate.period[c])));
+      s.busyQ8 += uint64_t(it->width) * gate.q8[c];
+      ++s.hist[std::min<uint64_t>(it->width / opt.histBin, opt.histBins - 1)];
+    }
+  }
+
+  // coincidences: every accepted channel 0 pulse of the block against all channel 1 pulses
+  if (gate.channels >= 2)
+  {
+    const std::vector<Event> &a = gate.events[0];
+    const std::vector<Event> &b = gate.events[1];
+    auto first = std::lower_bound(a.begin(), a.end(), from, [](const Event &e, uint64_t t) { return e.start < t;});
+    for (auto it = first; it != a.end() && it->start < to; ++it)
+    {
+      if (pulseVerdict(it->width, it->height, opt.widthMin, opt.widthMax, opt.lld) != LM_ACCEPTED) { continue;}
+      uint64_t lo = (it->start > opt.coincMks) ? it->start - opt.coincMks : 0;
+      auto jt = std::lower_bound(b.begin(), b.end(), lo, [](const Event &e, uint64_t t) { return e.start < t;});
+      for (; jt != b.end() && jt->start <= it->start + opt.coincMks; ++jt)
+      {
+        if (pulseVerdict(jt->width, jt->height, opt.widthMin, opt.widthMax, opt.lld) == LM_ACCEPTED) { ++stats.coincidences;}
+      }
+    }
+  }
+
+  // Feynman-Y: the sub-gates of the block's Timer0 periods [from, to) (the block
+  // length is a multiple of every width), accepted pulses by their count period
+  stats.fy.assign(opt.fyWidths.size(), FeynmanStats());
+  for (size_t w = 0; w < opt.fyWidths.size(); w++)
+  {
+    uint16_t width = uint16_t(opt.fyWidths[w] / T0_PERIOD_MKS);   // [periods]
+    uint64_t first = from / T0_PERIOD_MKS / width;
+    uint64_t last = std::min(to / T0_PERIOD_MKS / width, gate.fySubGates[w]);
+    uint64_t subGates = (last > first) ? last - first : 0;
+    std::vector<uint64_t> counts(subGates, 0);
+    for (uint32_t c = 0; c < gate.channels; c++)
+    {
+      const std::vector<Event> &events = gate.events[c];
+      auto it = std::lower_bound(events.begin(), events.end(), first * width + 1,
+                                 [](const Event &e, uint64_t p) { return e.period < p;});
+      for (; it != events.end() && feynmanSubGate(uint32_t(it->period), width) < last; ++it)
+      {
+        char verdict = pulseVerdict(it->width, it->height, opt.widthMin, opt.widthMax, opt.lld);
+        counts[feynmanSubGate(uint32_t(it->period), width) - first] +=
+            pulseCounts(verdict, pulsePeriods(it->width, uint16_t(gate.period[c])));
+      }
+    }
+    FeynmanStats &fy = stats.fy[w];
+    for (uint64_t count : counts)
+    {
+      ++fy.n;
+      fy.s1 += count;
+      fy.s2 += (unsigned __int128)count * count;
+    }
+  }
+}
+
+// F records: sub-gates with 16 bit counts and 32 bit sums, Y by the firmware's
+// feynmanYPpm(); R records: the accepted events in handler order through rossiPair()
+void checkGate(const Gate &gate, const Options &opt, GateCheck &check)
+{
+  for (const Mark *record : gate.feynman)
+  {
+    FeynmanCheck result;
+    uint64_t width = record->mks / T0_PERIOD_MKS;   // [periods]
+    uint64_t subGates = record->counts[0];
+    if (record->mks % T0_PERIOD_MKS == 0 && width > 0 && width <= 0xFFFF && subGates <= UINT32_MAX)
+    {
+      result.valid = true;
+      uint64_t lastPeriod = 0;
+      for (uint32_t c = 0; c < gate.channels; c++)
+      {
+        if (!gate.events[c].empty()) { lastPeriod = std::max(lastPeriod, gate.events[c].back().period);}
+      }
+      // sub-gates after the last event are empty
+      std::vector<uint16_t> counts(std::min(subGates, lastPeriod / width + 1), 0);
+      for (uint32_t c = 0; c < gate.channels; c++)
+      {
+        for (const Event &e : gate.events[c])
+        {
+          if (e.period == 0) { continue;}   // before the first tick
+          uint64_t k = feynmanSubGate(uint32_t(e.period), uint16_t(width));
+          if (k >= counts.size()) { break;}
+          char verdict = pulseVerdict(e.width, e.height, opt.widthMin, opt.widthMax, opt.lld);
+          counts[k] += pulseCounts(verdict, pulsePeriods(e.width, uint16_t(gate.period[c])));
+        }
+      }
+      uint64_t sumSq = 0;
+      for (uint16_t count : counts)
+      {
+        result.counts += count;
+        sumSq += uint32_t(count) * count;
+      }
+      result.yPpm = feynmanYPpm(uint32_t(subGates), result.counts, sumSq);
+    }
+    check.feynman.push_back(result);
+  }
+
+  rossiClear(check.rossi);
+  for (const Pulse &pulse : gate.accepted) { rossiPair(check.rossi, pulse.channel, uint32_t(pulse.start));}
+}
+
+// Y = (n * S2 - S1^2) / (n * S1) - 1
+double feynmanY(const FeynmanStats &fy)
+{
+  if (fy.n == 0 || fy.s1 == 0) { return 0.0;}
+  unsigned __int128 num = (unsigned __int128)fy.n * fy.s2 - (unsigned __int128)fy.s1 * fy.s1;
+  unsigned __int128 den = (unsigned __int128)fy.n * fy.s1;
+  return double(num) / double(den) - 1.0;
+}
+
+// returns false on a firmware mismatch
+bool report(const Gate &gate, const BlockStats &stats, const GateCheck &check, const Options &opt)
+{
+  uint64_t live = gate.liveMks();
+  bool checkable = gate.ended && gate.lost == 0 && gate.resets == 0;
+  const char *skipped = gate.lost ? "lost events" : gate.resets ? "warm restart" : "incomplete gate";
+  bool ok = true;
+
+  printf("gate %llu (%s:%llu) start %llu mks, source %c, live %.6f s%s", (unsigned long long)gate.number,
+         gate.file.c_str(), (unsigned long long)gate.line, (unsigned long long)gate.startMks, gate.source,
+         live / 1e6, gate.ended ? "" : " (no G record)");
+  if (gate.ended) { printf(", end %c", gate.end->reason);}
+  if (gate.lost) { printf(", lost events %llu", (unsigned long long)gate.lost);}
+  if (gate.resets) { printf(", resets %llu", (unsigned long long)gate.resets);}
+  printf("\n");
+
+  for (uint32_t c = 0; c < gate.channels; c++)
+  {
+    const ChannelStats &s = stats.ch[c];
+    double busy = s.busyQ8 / 256.0;
+    printf("  ch%u: events %llu (A %llu, S %llu, L %llu, H %llu)  counts %llu  rate %.3f cps\n", c,
+           (unsigned long long)s.events, (unsigned long long)s.verdicts[0], (unsigned long long)s.verdicts[1],
+           (unsigned long long)s.verdicts[2], (unsigned long long)s.verdicts[3], (unsigned long long)s.counts,
+           rateMilliCps(uint32_t(s.counts), uint32_t(live)) / 1000.0);
+    printf("       busy %.3f %%\n", live ? 100.0 * busy / live : 0.0);
+
+    printf("       widths [x%u ticks]:", opt.histBin);
+    for (size_t i = 0; i < s.hist.size(); i++)
+    {
+      if (s.hist[i]) { printf(" %zu:%llu", i, (unsigned long long)s.hist[i]);}
+    }
+    printf("\n");
+
+    if (!checkable)
+    {
+      printf("       firmware check: skipped (%s)\n", skipped);
+      continue;
+    }
+    // the firmware counters are 16 bit
+    const Mark &g = *gate.end;
+    bool countsOk = (s.counts & 0xFFFF) == g.counts[c];
+    bool shortOk = (s.verdicts[1] & 0xFFFF) == g.rejShort[c];
+    bool longOk = (s.verdicts[2] & 0xFFFF) == g.rejLong[c];
+    if (countsOk && shortOk && longOk && s.flagMismatch == 0)
+    {
+      printf("       firmware check: match\n");
+      continue;
+    }
+    ok = false;
+    printf("       firmware check: MISMATCH counts %llu/%llu short %llu/%llu long %llu/%llu flags %llu\n",
+           (unsigned long long)(s.counts & 0xFFFF), (unsigned long long)g.counts[c],
+           (unsigned long long)(s.verdicts[1] & 0xFFFF), (unsigned long long)g.rejShort[c],
+           (unsigned long long)(s.verdicts[2] & 0xFFFF), (unsigned long long)g.rejLong[c],
+           (unsigned long long)s.flagMismatch);
+  }
+
+  if (gate.channels >= 2 && live > 0)
+  {
+    // accidental pairs: 2 * window * rate0 * rate1 * live
+    double accidental = 2.0 * opt.coincMks * stats.ch[0].verdicts[0] * stats.ch[1].verdicts[0] / live;
+    printf("  coincidences ch0/ch1 +-%llu mks: %llu  accidental %.1f\n", (unsigned long long)opt.coincMks,
+           (unsigned long long)stats.coincidences, accidental);
+  }
+  for (size_t w = 0; w < opt.fyWidths.size(); w++)
+  {
+    const FeynmanStats &fy = stats.fy[w];
+    printf("  Feynman-Y T = %llu mks  n = %llu  mean = %.3f  Y = %.6f\n", (unsigned long long)opt.fyWidths[w],
+           (unsigned long long)fy.n, fy.n ? double(fy.s1) / fy.n : 0.0, feynmanY(fy));
+  }
+
+  // F records
+  for (size_t i = 0; i < gate.feynman.size(); i++)
+  {
+    const Mark &f = *gate.feynman[i];
+    const FeynmanCheck &r = check.feynman[i];
+    printf("  firmware check F T = %llu mks: ", (unsigned long long)f.mks);
+    if (!checkable || !gate.periods)
+    {
+      printf("skipped (%s)\n", checkable ? "no count periods in the E records" : skipped);
+      continue;
+    }
+    if (r.valid && r.counts == f.counts[1] && r.yPpm == f.value)
+    {
+      printf("match\n");
+      continue;
+    }
+    ok = false;
+    printf("MISMATCH counts %llu/%llu Y %lld/%lld ppm\n", (unsigned long long)r.counts,
+           (unsigned long long)f.counts[1], (long long)r.yPpm, (long long)f.value);
+  }
+
+  // R records: streamed increments are summed, the firmware counters are 16 bit
+  if (!gate.rossi.empty())
+  {
+    uint64_t events = 0, truncated = 0;
+    std::vector<uint64_t> pairs[2] {std::vector<uint64_t>(RA_BINS, 0), std::vector<uint64_t>(RA_BINS, 0)};
+    bool setup = true;
+    for (const Mark *r : gate.rossi)
+    {
+      if (r->mks != (1u << RA_BIN_SHIFT) || r->bins.size() != RA_BINS) { setup = false; break;}
+      int type = (r->reason == 'S') ? RA_SAME : RA_CROSS;
+      if (type == RA_SAME) { events += r->counts[0]; truncated += r->counts[1];}
+      for (size_t b = 0; b < RA_BINS; b++) { pairs[type][b] += r->bins[b];}
+    }
+    printf("  firmware check R: ");
+    if (!checkable || !setup)
+    {
+      printf("skipped (%s)\n", checkable ? "bins differ from src/RossiAlpha.h" : skipped);
+      return ok;
+    }
+    uint64_t binMismatch = 0;
+    for (int type = RA_SAME; type <= RA_CROSS; type++)
+    {
+      for (size_t b = 0; b < RA_BINS; b++)
+      {
+        if (std::min<uint64_t>(pairs[type][b], 0xFFFF) != check.rossi.histogram[type][b]) { ++binMismatch;}
+      }
+    }
+    if ((events & 0xFFFF) == check.rossi.eventNumber && (truncated & 0xFFFF) == check.rossi.truncated &&
+        binMismatch == 0)
+    {
+      printf("match\n");
+      return ok;
+    }
+    ok = false;
+    printf("MISMATCH events %u/%llu truncated %u/%llu bins %llu\n", check.rossi.eventNumber,
+           (unsigned long long)(events & 0xFFFF), check.rossi.truncated, (unsigned long long)(truncated & 0xFFFF),
+           (unsigned long long)binMismatch);
+  }
+  return ok;
+}
+
+struct MappedFile
+{
+  const char *data = nullptr;
+  size_t size = 0;
+
+  bool open(const char *path)
+  {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) { perror(path); return false;}
+    struct stat st;
+    if (fstat(fd, &st) < 0) { perror(path); close(fd); return false;}
+    size = size_t(st.st_size);
+    if (size > 0)
+    {
+      void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) { perror(path); close(fd); return false;}
+      madvise(p, size, MADV_SEQUENTIAL);
+      data = static_cast<const char *>(p);
+    }
+    close(fd);
+    return true;
+  }
+
+  ~MappedFile()
+  {
+    if (data) { munmap(const_cast<char *>(data), size);}
+  }
+};
+
+bool parseList(const char *text, std::vector<uint64_t> &values)
+{
+  values.clear();
+  while (*text)
+  {
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (end == text || errno || v == 0) { return false;}
+    values.push_back(v);
+    text = (*end == ',') ? end + 1 : end;
+    if (*end && *end != ',') { return false;}
+  }
+  return !values.empty();
+}
+
+void usage()
+{
+  fprintf(stderr, "usage: nc_analyze [-j threads] [-m width_min] [-M width_max] [-l lld] [-c coinc_mks] "
+                  "[-H hist_bin_ticks] [-n hist_bins] [-f fy_mks[,fy_mks...]] [-B block_ms] FILE [FILE ...]\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  int o;
+  while ((o = getopt(argc, argv, "j:m:M:l:c:H:n:f:B:h")) != -1)
+  {
+    switch (o)
+    {
+      case 'j': opt.threads = unsigned(strtoul(optarg, nullptr, 10)); break;
+      case 'm': opt.widthMin = uint32_t(strtoul(optarg, nullptr, 10)); break;
+      case 'M': opt.widthMax = uint32_t(strtoul(optarg, nullptr, 10)); break;
+      case 'l': opt.lld = uint8_t(strtoul(optarg, nullptr, 10)); break;
+      case 'c': opt.coincMks = strtoull(optarg, nullptr, 10); break;
+      case 'H': opt.histBin = uint32_t(strtoul(optarg, nullptr, 10)); break;
+      case 'n': opt.histBins = uint32_t(strtoul(optarg, nullptr, 10)); break;
+      case 'f': if (!parseList(optarg, opt.fyWidths)) { usage(); return 2;} break;
+      case 'B': opt.blockMks = strtoull(optarg, nullptr, 10) * 1000; break;
+      default: usage(); return 2;
+    }
+  }
+  if (optind >= argc || opt.histBin == 0 || opt.histBins == 0 || opt.blockMks == 0) { usage(); return 2;}
+  if (opt.threads == 0) { opt.threads = std::max(1u, std::thread::hardware_concurrency());}
+
+  // time blocks hold whole Feynman-Y sub-gates of every width
+  uint64_t unit = *std::max_element(opt.fyWidths.begin(), opt.fyWidths.end());
+  for (uint64_t w : opt.fyWidths)
+  {
+    if (unit % w) { fprintf(stderr, "Feynman-Y widths must divide the longest one\n"); return 2;}
+    if (w % T0_PERIOD_MKS || w / T0_PERIOD_MKS > 0xFFFF)
+    {
+      fprintf(stderr, "Feynman-Y widths must be whole Timer0 periods (%llu mks)\n", (unsigned long long)T0_PERIOD_MKS);
+      return 2;
+    }
+  }
+  opt.blockMks = std::max<uint64_t>(1, (opt.blockMks + unit - 1) / unit) * unit;
+
+  bool allOk = true;
+  for (int i = optind; i < argc; i++)
+  {
+    MappedFile file;
+    if (!file.open(argv[i])) { return 1;}
+
+    std::vector<ParseBlock> blocks = splitBlocks(file.data, file.data + file.size, opt.threads);
+    runParallel(blocks.size(), opt.threads, [&](size_t b) { parseBlock(blocks[b]);});
+
+    uint64_t lines = 0, badLines = 0, outside = 0;
+    for (const ParseBlock &block : blocks) { lines += block.lines; badLines += block.badLines;}
+    std::vector<Gate> gates;
+    buildGates(argv[i], blocks, opt, gates, outside);
+
+    // Feynman-Y sub-gates per width: as many as in the gate's F record of the same width,
+    // else the complete ones after the first tick of the live time
+    for (Gate &gate : gates)
+    {
+      uint64_t ticks = gate.liveMks() / T0_PERIOD_MKS;
+      for (uint64_t width : opt.fyWidths)
+      {
+        uint64_t subGates = (ticks > 1) ? (ticks - 1) / (width / T0_PERIOD_MKS) : 0;
+        for (const Mark *f : gate.feynman)
+        {
+          if (f->mks == width) { subGates = f->counts[0];}
+        }
+        gate.fySubGates.push_back(subGates);
+      }
+    }
+    std::vector<GateCheck> checks(gates.size());
+    runParallel(gates.size(), opt.threads, [&](size_t g) { checkGate(gates[g], opt, checks[g]);});
+
+    // time block jobs of all gates, results are merged in job order
+    struct Job { size_t gate; uint64_t from; uint64_t to;};
+    std::vector<Job> jobs;
+    for (size_t g = 0; g < gates.size(); g++)
+    {
+      uint64_t live = gates[g].liveMks();
+      uint64_t last = live;
+      for (uint32_t c = 0; c < gates[g].channels; c++)
+      {
+        if (!gates[g].events[c].empty()) { last = std::max(last, gates[g].events[c].back().start);}
+      }
+      for (uint64_t t = 0; t <= last; t += opt.blockMks) { jobs.push_back(Job {g, t, t + opt.blockMks});}
+    }
+    std::vector<BlockStats> results(jobs.size());
+    runParallel(jobs.size(), opt.threads, [&](size_t j) {
+      const Gate &gate = gates[jobs[j].gate];
+      analyseBlock(gate, jobs[j].from, jobs[j].to, opt, results[j]);
+    });
+
+    printf("%s: lines %llu, gates %zu, bad records %llu, records outside gates %llu\n", argv[i],
+           (unsigned long long)lines, gates.size(), (unsigned long long)badLines, (unsigned long long)outside);
+    size_t j = 0;
+    for (size_t g = 0; g < gates.size(); g++)
+    {
+      BlockStats total;
+      for (uint32_t c = 0; c < gates[g].channels; c++) { total.ch[c].hist.assign(opt.histBins, 0);}
+      total.fy.assign(opt.fyWidths.size(), FeynmanStats());
+      for (; j < jobs.size() && jobs[j].gate == g; j++) { total.merge(results[j], gates[g].channels);}
+      if (!report(gates[g], total, checks[g], opt)) { allOk = false;}
+    }
+  }
+  return allOk ? 0 : 3;
+}
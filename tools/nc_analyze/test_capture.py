@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+# nc_analyze test: the firmware check against a firmware capture.
+# test_capture.txt holds two 10 s gates of the firmware sources (list mode,
+# Feynman-Y and Rossi-alpha enabled, default setup) driven by simulated
+# correlated pulse trains on both channels (tools/fw_sim, make -C tools capture).
+# The capture must pass the check, copies with one altered record must fail it
+# (exit status 3).
+#
+# usage:  test_capture.py [path to nc_analyze]   (make -C tools test)
+
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ANALYZE = sys.argv[1] if len(sys.argv) > 1 else os.path.join(HERE, 'nc_analyze')
+CAPTURE = os.path.join(HERE, 'test_capture.txt')
+
+
+def run(path, *options):
+    proc = subprocess.run([ANALYZE, *options, path], stdout=subprocess.PIPE, text=True)
+    return proc.returncode, proc.stdout
+
+
+def check(name, condition):
+    print(('ok    ' if condition else 'FAIL  ') + name)
+    return condition
+
+
+def altered(lines, record, occurrence, field, change):
+    # copy of the capture with one field of the n-th record of a kind changed
+    result = list(lines)
+    seen = 0
+    for i, line in enumerate(result):
+        if line.startswith(record + ','):
+            seen += 1
+            if seen == occurrence:
+                f = line.rstrip('\n').split(',')
+                f[field] = change(f[field])
+                result[i] = ','.join(f) + '\n'
+                return result
+    raise ValueError('no record ' + record)
+
+
+def main():
+    with open(CAPTURE) as f:
+        lines = f.readlines()
+
+    ok = True
+    status, out = run(CAPTURE)
+    ok &= check('capture passes the firmware check', status == 0)
+    ok &= check('G, F and R records are checked',
+                out.count('firmware check: match') == 4 and out.count('firmware check F') == 12 and
+                out.count('firmware check R: match') == 2 and 'skipped' not in out)
+    status, same = run(CAPTURE, '-j', '1', '-B', '300')
+    ok &= check('result does not depend on threads and blocks', status == 0 and
+                same.split('\n', 1)[1] == out.split('\n', 1)[1])
+
+    cases = [
+        ('G counts', 'G', 2, 4, lambda v: str(int(v) + 1)),
+        ('E flag', 'E', 10, 5, lambda v: 'S' if v == 'A' else 'A'),
+        ('E count period', 'E', 10, 6, lambda v: str(int(v) + 300)),
+        ('F counts', 'F', 3, 4, lambda v: str(int(v) - 1)),
+        ('F Feynman-Y', 'F', 12, 5, lambda v: str(int(v) + 1)),
+        ('R cross pairs', 'R', 2, 7, lambda v: str(int(v) + 1)),
+        ('R events', 'R', 3, 4, lambda v: str(int(v) - 1)),
+    ]
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'altered.txt')
+        for name, record, occurrence, field, change in cases:
+            with open(path, 'w') as f:
+                f.writelines(altered(lines, record, occurrence, field, change))
+            status, out = run(path)
+            ok &= check('altered ' + name + ' is found', status == 3 and 'MISMATCH' in out)
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())